@@ -18,7 +18,12 @@ Main reference: https://espressif-docs.readthedocs-hosted.com/projects/arduino-e
 */
 
 #include "ESP32NowLib.h"
+#include <SFDFTrace.h>
 
+// flooded frames and time beacons go to the broadcast address
+static const uint8_t broadcastMac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+ESP32Now* ESP32Now::rxInstance = nullptr;
 
 ESP32Now::ESP32Now(int channel):channel(channel) {}
 
@@ -41,6 +46,7 @@ void ESP32Now::ESPNowStartMaster(void (&onDataSent)(const uint8_t *mac_addr, esp
 void ESP32Now::ESPNowStartSlave(String ssid, void (&onDataRec)(const uint8_t *mac_addr, const uint8_t *data, int data_len))
 {
     slaveName = ssid;
+    isSlave = true;
     WiFi.mode(WIFI_AP);
     bool result = WiFi.softAP(ssid, "Slave_1_Password", channel, 0);
 
@@ -61,6 +67,290 @@ void ESP32Now::ESPNowStartSlave(String ssid, void (&onDataRec)(const uint8_t *ma
     esp_now_register_recv_cb(onDataRec);
 }
 
+void ESP32Now::ESPNowStartSlave(String ssid)
+{
+    // only one node per ESP32, the static callback hands frames to this instance
+    rxInstance = this;
+    ESPNowStartSlave(ssid, onDataRecvQueued);
+}
+
+void ESP32Now::onDataRecvQueued(const uint8_t *mac_addr, const uint8_t *data, int data_len)
+{
+    // runs in the WiFi task, so only copy the frame and wake the dispatcher, never run actuator logic here
+    ESP32Now* node = rxInstance;
+    if (node == nullptr || data_len <= 0)
+    {
+        return;
+    }
+
+    espNowFrame* frame = node->rxQueue.writeSlot();
+    if (frame == nullptr)
+    {
+        // queue full, frame is counted as dropped
+        return;
+    }
+    memcpy(frame->mac, mac_addr, ESP_NOW_ETH_ALEN);
+    frame->length = min(data_len, ESP_NOW_MAX_DATA_LEN);
+    // stamp arrival here and not in dispatch(), queue wait would otherwise count as air delay
+    frame->rxTime = esp_timer_get_time();
+    memcpy(frame->data, data, frame->length);
+    frame->data[frame->length] = 0;
+    node->rxQueue.commitWrite();
+
+    if (node->dispatchTaskHandle != nullptr)
+    {
+        xTaskNotifyGive(node->dispatchTaskHandle);
+    }
+}
+
+bool ESP32Now::addHandler(const char* command, espNowHandler handler)
+{
+    if (handlerCount >= ESPNOW_MAX_HANDLERS || strlen(command) > ESPNOW_MAX_COMMAND_LEN)
+    {
+        Serial.print("Failed to add handler for "); Serial.println(command);
+        return false;
+    }
+    strcpy(handlers[handlerCount].command, command);
+    handlers[handlerCount].handler = handler;
+    ++handlerCount;
+    return true;
+}
+
+int ESP32Now::dispatch()
+{
+    SFDF_TRACE_SCOPE("espnow_dispatch");
+    int handled = 0;
+    espNowFrame* frame;
+    while ((frame = rxQueue.readSlot()) != nullptr)
+    {
+        if (strncmp(frame->data, TIMESYNC_COMMAND " ", sizeof(TIMESYNC_COMMAND)) == 0)
+        {
+            // every node hears the master's beacons, ones without time sync just drop them
+            if (timeSyncEnabled)
+            {
+                clockSync.addBeacon(strtoll(frame->data + sizeof(TIMESYNC_COMMAND), NULL, 10), frame->rxTime);
+            }
+        }
+        else if (relayEnabled && frame->length >= sizeof(relayHeader) && (uint8_t)frame->data[0] == RELAY_MAGIC)
+        {
+            handleRelayFrame(frame);
+        }
+        else
+        {
+            currentOrigin = RELAY_BROADCAST;
+            handleCommand(frame->mac, frame->data, frame->length);
+        }
+
+        // only give the slot back once the handler is done with args
+        rxQueue.commitRead();
+        ++handled;
+    }
+    return handled;
+}
+
+void ESP32Now::handleCommand(const uint8_t *mac_addr, const char *data, size_t length)
+{
+    // split message into command and arguments at the first space
+    const char* args = strchr(data, ' ');
+    size_t commandLen = args != NULL ? size_t(args - data) : length;
+    args = args != NULL ? args + 1 : data + length;
+
+    for (uint8_t i = 0; i < handlerCount; ++i)
+    {
+        if (strlen(handlers[i].command) == commandLen && strncmp(handlers[i].command, data, commandLen) == 0)
+        {
+            handlers[i].handler(mac_addr, args);
+            return;
+        }
+    }
+    Serial.print("No handler for: "); Serial.println(data);
+}
+
+void ESP32Now::enableRelay(uint8_t nodeId)
+{
+    portENTER_CRITICAL(&routerLock);
+    router.begin(nodeId);
+    portEXIT_CRITICAL(&routerLock);
+    relayEnabled = true;
+
+    // relays have to receive as well, master only registered a send callback
+    rxInstance = this;
+    esp_now_register_recv_cb(onDataRecvQueued);
+
+    // slaves need station mode too so they can scan for neighbors, AP keeps running
+    if (isSlave)
+    {
+        WiFi.mode(WIFI_AP_STA);
+    }
+
+    ensurePeer(broadcastMac);
+}
+
+int ESP32Now::scanNeighbors(String prefix)
+{
+    SFDF_TRACE_SCOPE("espnow_scan_neighbors");
+    int found = 0;
+    int16_t scanResults = WiFi.scanNetworks(false, false, false, 300, channel); // Scan only on one channel
+    for (int i = 0; i < scanResults; ++i)
+    {
+        if (WiFi.SSID(i).indexOf(prefix) == 0)
+        {
+            const uint8_t* mac = WiFi.BSSID(i);
+            int8_t rssi = (int8_t)WiFi.RSSI(i);
+            portENTER_CRITICAL(&routerLock);
+            router.updateNeighbor(mac, rssi);
+            portEXIT_CRITICAL(&routerLock);
+            ensurePeer(mac);
+            ++found;
+        }
+    }
+
+    // clean up ram
+    WiFi.scanDelete();
+    return found;
+}
+
+bool ESP32Now::ensurePeer(const uint8_t* mac)
+{
+    if (esp_now_is_peer_exist(mac))
+    {
+        return true;
+    }
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    peer.channel = channel;
+    peer.encrypt = 0;
+    // slaves in AP mode have to send from the AP interface
+    peer.ifidx = isSlave ? WIFI_IF_AP : WIFI_IF_STA;
+    return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+bool ESP32Now::relaySend(uint8_t dest, const uint8_t* data, size_t length, uint8_t ttl)
+{
+    if (!relayEnabled || length > RELAY_MAX_PAYLOAD)
+    {
+        return false;
+    }
+
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+    portENTER_CRITICAL(&routerLock);
+    relayHeader header = {RELAY_MAGIC, router.nodeId(), dest, ttl, 0, router.nextSeq()};
+    // don't forward our own frame when it is flooded back to us
+    router.isDuplicate(header.origin, header.seq);
+    portEXIT_CRITICAL(&routerLock);
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), data, length);
+
+    return sendRelayFrame(dest, frame, sizeof(header) + length);
+}
+
+bool ESP32Now::relaySend(uint8_t dest, const char* message)
+{
+    return relaySend(dest, (const uint8_t*)message, strlen(message));
+}
+
+bool ESP32Now::sendRelayFrame(uint8_t dest, const uint8_t* frame, size_t length)
+{
+    // copy the next hop, the route may be replaced by the other task once the lock is let go
+    uint8_t next[ESP_NOW_ETH_ALEN];
+    unsigned long now = millis();
+    portENTER_CRITICAL(&routerLock);
+    const uint8_t* hop = router.nextHop(dest, now);
+    memcpy(next, hop != nullptr ? hop : broadcastMac, ESP_NOW_ETH_ALEN);
+    portEXIT_CRITICAL(&routerLock);
+
+    // no route yet, flood it and let the reply teach us the route
+    if (hop != nullptr)
+    {
+        ensurePeer(next);
+    }
+    return esp_now_send(next, frame, length) == ESP_OK;
+}
+
+void ESP32Now::handleRelayFrame(espNowFrame* frame)
+{
+    relayHeader header;
+    memcpy(&header, frame->data, sizeof(header));
+    unsigned long now = millis();
+    portENTER_CRITICAL(&routerLock);
+    uint8_t action = router.receive(header, frame->mac, now);
+    portEXIT_CRITICAL(&routerLock);
+
+    // forward first so downstream latency doesn't include our handler
+    if (action & RELAY_FORWARD)
+    {
+        memcpy(frame->data, &header, sizeof(header));
+        sendRelayFrame(header.dest, (const uint8_t*)frame->data, frame->length);
+    }
+
+    if (action & RELAY_DELIVER)
+    {
+        currentOrigin = header.origin;
+        handleCommand(frame->mac, frame->data + sizeof(header), frame->length - sizeof(header));
+        currentOrigin = RELAY_BROADCAST;
+    }
+}
+
+bool ESP32Now::sendTimeBeacon()
+{
+    ensurePeer(broadcastMac);
+
+    // read the clock as late as possible so the beacon time is close to when it goes on air
+    char beacon[32];
+    int length = snprintf(beacon, sizeof(beacon), TIMESYNC_COMMAND " %lld", (long long)esp_timer_get_time());
+    return esp_now_send(broadcastMac, (const uint8_t*)beacon, length) == ESP_OK;
+}
+
+void ESP32Now::enableTimeSync()
+{
+    timeSyncEnabled = true;
+}
+
+timeSync& ESP32Now::syncedClock()
+{
+    return clockSync;
+}
+
+uint8_t ESP32Now::relayOrigin()
+{
+    return currentOrigin;
+}
+
+void ESP32Now::printRoutes()
+{
+    // print a copy, Serial can't be used while holding the lock
+    relayRouter snapshot;
+    portENTER_CRITICAL(&routerLock);
+    snapshot = router;
+    portEXIT_CRITICAL(&routerLock);
+    snapshot.printRoutes(&Serial, millis());
+}
+
+void ESP32Now::dispatchTask(void *param)
+{
+    ESP32Now* node = (ESP32Now*)param;
+    for (;;)
+    {
+        // sleep until onDataRecvQueued notifies, time out once a second in case a notify was missed
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+        node->dispatch();
+    }
+}
+
+bool ESP32Now::startDispatchTask(uint32_t stackSize, UBaseType_t priority)
+{
+    if (dispatchTaskHandle != nullptr)
+    {
+        return true;
+    }
+    return xTaskCreate(dispatchTask, "espnow_dispatch", stackSize, this, priority, &dispatchTaskHandle) == pdPASS;
+}
+
+uint32_t ESP32Now::droppedFrames()
+{
+    return rxQueue.droppedCount();
+}
+
 void ESP32Now::InitESPNow() 
 {
   WiFi.disconnect();
@@ -79,6 +369,7 @@ void ESP32Now::InitESPNow()
 
 bool ESP32Now::addPeer(String name) 
 {
+    SFDF_TRACE_SCOPE("espnow_add_peer");
     uint8_t macAddr[6] = {0};
     bool slaveFound = false;
     Serial.println("");
@@ -125,6 +416,7 @@ bool ESP32Now::addPeer(String name)
                 macAddr[j] = (uint8_t) mac[j];
             }
           }
+          cachePeer(name, macAddr);
           bool exists = esp_now_is_peer_exist(macAddr);
           if(!exists)
           {
@@ -211,14 +503,50 @@ void ESP32Now::deletePeer(const uint8_t* addr)
 }
 
 
-void ESP32Now::sendDataAll(String data) 
+void ESP32Now::cachePeer(const String& name, const uint8_t* mac)
 {
+    if (name.length() > ESPNOW_PEER_NAME_LEN)
+    {
+        return;
+    }
 
-    Serial.print("Sending: "); Serial.println(data);
-    esp_err_t result = esp_now_send(0, (uint8_t*)&data, sizeof(data)); // first param null means send to all connected addressses
-    
-    
-    
+    portENTER_CRITICAL(&peerCacheLock);
+    uint8_t index = 0;
+    while (index < peerCacheCount && strcmp(peerCache[index].name, name.c_str()) != 0)
+    {
+        ++index;
+    }
+    if (index < ESPNOW_PEER_CACHE_SIZE)
+    {
+        memcpy(peerCache[index].name, name.c_str(), name.length() + 1);
+        memcpy(peerCache[index].mac, mac, ESP_NOW_ETH_ALEN);
+        if (index == peerCacheCount)
+        {
+            peerCacheCount++;
+        }
+    }
+    portEXIT_CRITICAL(&peerCacheLock);
+}
+
+bool ESP32Now::findCachedPeer(const String& name, uint8_t* mac)
+{
+    bool found = false;
+    portENTER_CRITICAL(&peerCacheLock);
+    for (uint8_t i = 0; i < peerCacheCount; ++i)
+    {
+        if (strcmp(peerCache[i].name, name.c_str()) == 0)
+        {
+            memcpy(mac, peerCache[i].mac, ESP_NOW_ETH_ALEN);
+            found = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&peerCacheLock);
+    return found;
+}
+
+void ESP32Now::printSendStatus(esp_err_t result)
+{
     Serial.print("Send Status: ");
     if (result == ESP_OK) {
       Serial.println("Success");
@@ -238,24 +566,46 @@ void ESP32Now::sendDataAll(String data)
     }
 }
 
+void ESP32Now::sendDataAll(String data) 
+{
+    SFDF_TRACE_SCOPE("espnow_send_all");
+
+    Serial.print("Sending: "); Serial.println(data);
+
+    // esp_now_send(NULL, ...) would also hit the broadcast peer relay mode adds, and every slave would get the command twice.
+    // esp_now_fetch_peer() only returns unicast peers, so send to each of those instead
+    esp_err_t result = ESP_ERR_ESPNOW_NOT_FOUND;
+    esp_now_peer_info_t peer;
+    for (bool first = true; esp_now_fetch_peer(first, &peer) == ESP_OK; first = false)
+    {
+        esp_err_t peerResult = esp_now_send(peer.peer_addr, (const uint8_t*)data.c_str(), data.length());
+        if (result == ESP_ERR_ESPNOW_NOT_FOUND || peerResult != ESP_OK)
+        {
+            result = peerResult;
+        }
+    }
+    printSendStatus(result);
+}
+
 void ESP32Now::sendDataSingle(String data, String name)
 {
+    SFDF_TRACE_SCOPE("espnow_send_single");
     uint8_t macAddr[6] = {0};
-    bool slaveFound = false;
-    Serial.println("");
+    bool slaveFound = findCachedPeer(name, macAddr);
 
-    // Scan network
-    int16_t scanResults = WiFi.scanNetworks(false, false, false, 300, channel); // Scan only on one channel
-    if (scanResults == 0) 
-    {
-      Serial.println("No WiFi devices in AP Mode found");
-      WiFi.scanDelete();
-      return;
-    } 
-    else 
+    // Scan network only if the mac address isn't known yet
+    if (!slaveFound)
     {
+      Serial.println("");
+      int16_t scanResults = WiFi.scanNetworks(false, false, false, 300, channel); // Scan only on one channel
+      if (scanResults == 0) 
+      {
+        Serial.println("No WiFi devices in AP Mode found");
+        WiFi.scanDelete();
+        return;
+      } 
+
       // Check scan results
-      // Serial.print("Found "); Serial.print(scanResults); Serial.println(" devices ");
       for (int i = 0; i < scanResults; ++i) 
       {
         // Print SSID and RSSI for each device found
@@ -263,14 +613,6 @@ void ESP32Now::sendDataSingle(String data, String name)
         int32_t RSSI = WiFi.RSSI(i);
         String BSSIDstr = WiFi.BSSIDstr(i);
 
-        //   Serial.print(i + 1);
-        //   Serial.print(": ");
-        //   Serial.print(SSID);
-        //   Serial.print(" (");
-        //   Serial.print(RSSI);
-        //   Serial.print(")");
-        //   Serial.println("");
-      
         delay(10);
         // Check if the current device matches name
         if (SSID.indexOf(name) == 0) {
@@ -287,6 +629,8 @@ void ESP32Now::sendDataSingle(String data, String name)
             {
                 macAddr[j] = (uint8_t) mac[j];
             }
+            cachePeer(name, macAddr);
+            slaveFound = true;
           }
 
           // we are planning to have only one slave in this example;
@@ -294,35 +638,17 @@ void ESP32Now::sendDataSingle(String data, String name)
           break;
         }
       }
+      WiFi.scanDelete();
     }
 
-    if(macAddr!=nullptr)
+    if(slaveFound)
     {
-
+      ensurePeer(macAddr);
       Serial.print("Sending: "); Serial.println(data);
       // send to specified address
-      esp_err_t result = esp_now_send(macAddr, (uint8_t*)&data, sizeof(data)); 
-
-
-      Serial.print("Send Status: ");
-      if (result == ESP_OK) {
-        Serial.println("Success");
-      } else if (result == ESP_ERR_ESPNOW_NOT_INIT) {
-        // How did we get so far!!
-        Serial.println("ESPNOW not Init.");
-      } else if (result == ESP_ERR_ESPNOW_ARG) {
-        Serial.println("Invalid Argument");
-      } else if (result == ESP_ERR_ESPNOW_INTERNAL) {
-        Serial.println("Internal Error");
-      } else if (result == ESP_ERR_ESPNOW_NO_MEM) {
-        Serial.println("ESP_ERR_ESPNOW_NO_MEM");
-      } else if (result == ESP_ERR_ESPNOW_NOT_FOUND) {
-        Serial.println("Peer not found.");
-      } else {
-        Serial.println("Not sure what happened");
-      }
+      esp_err_t result = esp_now_send(macAddr, (const uint8_t*)data.c_str(), data.length()); 
+      printSendStatus(result);
     }
-    WiFi.scanDelete();
 }
 
 void ESP32Now::printMacAddress(String name)
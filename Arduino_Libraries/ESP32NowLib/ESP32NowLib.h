@@ -10,6 +10,34 @@
 #include "WiFi.h"
 #include <esp_now.h>
 #include <esp_wifi.h>
+#include <esp_timer.h>
+#include "ESP32NowQueue.h"
+#include "ESP32NowRelay.h"
+#include "ESP32NowTimeSync.h"
+
+// Number of received frames that can wait for dispatch before new ones are dropped, must be a power of two.
+// Sensor slaves sample on the same synced tick, so the master gets a frame from up to TELEMETRY_MAX_NODES (16) slaves at
+// once, plus beacons and relayed copies, about 270 bytes each
+#define ESPNOW_RX_QUEUE_SIZE 32
+
+// Max number of commands that can be registered with addHandler()
+#define ESPNOW_MAX_HANDLERS 8
+
+// Max length of a command name (eg. "PUMPON")
+#define ESPNOW_MAX_COMMAND_LEN 15
+
+// Number of slave names whose mac address is remembered by addPeer()/sendDataSingle(), so later sends skip the WiFi scan
+#define ESPNOW_PEER_CACHE_SIZE 8
+
+// Max length of a cached slave name (eg. "Slave 1")
+#define ESPNOW_PEER_NAME_LEN 31
+
+/**!
+ * @brief Handler for one command, runs in the dispatching task not the WiFi task
+ * @param mac_addr mac address of sender
+ * @param args rest of the message after the command and a space (eg. "30" for "PUMPON 30"), empty string if none
+ */
+typedef void (*espNowHandler)(const uint8_t *mac_addr, const char *args);
 
 
 class ESP32Now
@@ -19,6 +47,96 @@ class ESP32Now
         esp_now_peer_info_t slave;
         String slaveName;
 
+        // received frames are copied here by the WiFi task callback and handled later by dispatch()
+        ringBuffer<espNowFrame, ESPNOW_RX_QUEUE_SIZE> rxQueue;
+
+        // command to handler table for dispatch()
+        struct commandHandler
+        {
+            char command[ESPNOW_MAX_COMMAND_LEN + 1];
+            espNowHandler handler;
+        };
+        commandHandler handlers[ESPNOW_MAX_HANDLERS];
+        uint8_t handlerCount = 0;
+
+        // task woken up by the receive callback, nullptr if dispatch() is called from loop() instead
+        TaskHandle_t dispatchTaskHandle = nullptr;
+
+        // relay mode state, see enableRelay()
+        relayRouter router;
+        // router is changed from loop() (relaySend, scanNeighbors) and from the dispatch task (handleRelayFrame)
+        portMUX_TYPE routerLock = portMUX_INITIALIZER_UNLOCKED;
+        bool relayEnabled = false;
+        bool isSlave = false;
+        uint8_t currentOrigin = RELAY_BROADCAST;
+
+        // time sync state, see enableTimeSync()
+        timeSync clockSync;
+        bool timeSyncEnabled = false;
+
+        // slave name to mac address, filled from scans so sendDataSingle() doesn't have to scan again
+        struct cachedPeer
+        {
+            char name[ESPNOW_PEER_NAME_LEN + 1];
+            uint8_t mac[ESP_NOW_ETH_ALEN];
+        };
+        cachedPeer peerCache[ESPNOW_PEER_CACHE_SIZE];
+        uint8_t peerCacheCount = 0;
+        portMUX_TYPE peerCacheLock = portMUX_INITIALIZER_UNLOCKED;
+
+        /**!
+        * @brief Remembers the mac address of a slave name, replaces the entry if the name is already cached
+        */
+        void cachePeer(const String& name, const uint8_t* mac);
+
+        /**!
+        * @brief Looks up a slave name in the cache
+        * @param mac set to the cached mac address if found
+        * @return true if found
+        */
+        bool findCachedPeer(const String& name, uint8_t* mac);
+
+        /**!
+        * @brief Prints the result of esp_now_send()
+        */
+        void printSendStatus(esp_err_t result);
+
+        /**!
+        * @brief Runs the registered handler whose command matches the first word of data
+        * @param mac_addr mac address passed on to handler
+        * @param data null terminated message
+        * @param length length of message
+        */
+        void handleCommand(const uint8_t *mac_addr, const char *data, size_t length);
+
+        /**!
+        * @brief Drops duplicates, learns the route back to the origin, forwards the frame if needed and delivers it if it is for this node
+        */
+        void handleRelayFrame(espNowFrame* frame);
+
+        /**!
+        * @brief Sends an already built relay frame to the next hop towards dest, or broadcasts it if there is no route
+        */
+        bool sendRelayFrame(uint8_t dest, const uint8_t* frame, size_t length);
+
+        /**!
+        * @brief Adds mac address as ESP-Now peer if not added yet
+        */
+        bool ensurePeer(const uint8_t* mac);
+
+        // esp_now_register_recv_cb only takes a plain function, so the callback finds the node through this
+        static ESP32Now* rxInstance;
+
+        /**!
+        * @brief Receive callback registered by the queued ESPNowStartSlave(), only copies the frame into rxQueue
+        */
+        static void onDataRecvQueued(const uint8_t *mac_addr, const uint8_t *data, int data_len);
+
+        /**!
+        * @brief FreeRTOS task started by startDispatchTask(), sleeps until a frame arrives then runs dispatch()
+        */
+        static void dispatchTask(void *param);
+
     public:
 
         /**!
@@ -40,6 +158,97 @@ class ESP32Now
         */
         void ESPNowStartSlave(String ssid, void (&onDataRec)(const uint8_t *mac_addr, const uint8_t *data, int data_len));
 
+        /**!
+        * @brief Start a slave node that queues received frames instead of handling them in the WiFi task.
+        * Register commands with addHandler(), then call dispatch() in loop() or use startDispatchTask().
+        * @param String of SSID name of slave you wish to set
+        */
+        void ESPNowStartSlave(String ssid);
+
+        /**!
+        * @brief Register a handler for a command, a frame matches if its first word is exactly the command (eg. "PUMPON" or "PUMPON 30")
+        * @param command name of command, at most ESPNOW_MAX_COMMAND_LEN characters
+        * @param handler function to run when command is received
+        * @return true if registered, false if table is full or command too long
+        */
+        bool addHandler(const char* command, espNowHandler handler);
+
+        /**!
+        * @brief Runs the handler for every queued frame, call this from loop() or let startDispatchTask() call it
+        * @return Number of frames handled
+        */
+        int dispatch();
+
+        /**!
+        * @brief Starts a FreeRTOS task that runs dispatch() as soon as a frame is received, so loop() doesn't have to poll
+        * @param stackSize stack size of task in bytes, handlers run on this stack
+        * @param priority task priority, keep it below the WiFi task
+        * @return true if task was created
+        */
+        bool startDispatchTask(uint32_t stackSize = 4096, UBaseType_t priority = 1);
+
+        /**!
+        * @brief Number of received frames dropped because the queue was full
+        */
+        uint32_t droppedFrames();
+
+        /**!
+        * @brief Turns on multi-hop relay mode. Frames sent with relaySend() carry a small header and are forwarded by other relay nodes
+        * until they reach the destination, so nodes beyond direct range can be reached. Works on master and slaves, every node
+        * needs a unique id and must call dispatch() (or startDispatchTask()) since forwarding is done there.
+        * @param nodeId unique id of this node (eg. 0 for master), not RELAY_BROADCAST
+        */
+        void enableRelay(uint8_t nodeId);
+
+        /**!
+        * @brief Scans for other nodes whose SSID starts with prefix, records their RSSI for next hop choice and adds them as peers
+        * @param prefix SSID prefix of nodes (eg. "Slave")
+        * @return Number of nodes found
+        */
+        int scanNeighbors(String prefix);
+
+        /**!
+        * @brief Sends a message through relay mode, uses the best known next hop or floods the frame if there is no route yet
+        * @param dest node id to send to, RELAY_BROADCAST for all nodes
+        * @param data message bytes, at most RELAY_MAX_PAYLOAD
+        * @param length number of bytes
+        * @param ttl max number of hops
+        * @return true if frame was handed to ESP-Now
+        */
+        bool relaySend(uint8_t dest, const uint8_t* data, size_t length, uint8_t ttl = RELAY_DEFAULT_TTL);
+
+        /**!
+        * @brief Same as above for a text command (eg. "PUMPON")
+        */
+        bool relaySend(uint8_t dest, const char* message);
+
+        /**!
+        * @brief Node id that sent the frame being handled, only valid inside a handler
+        * @return origin node id, RELAY_BROADCAST if frame came directly without relay header
+        */
+        uint8_t relayOrigin();
+
+        /**!
+        * @brief Prints relay routing table to Serial
+        */
+        void printRoutes();
+
+        /**!
+        * @brief Master only, broadcasts a time beacon with the master clock. Call it regularly (eg. every second) so slaves can follow the master clock.
+        * @return true if beacon was handed to ESP-Now
+        */
+        bool sendTimeBeacon();
+
+        /**!
+        * @brief Slave only, makes dispatch() feed received time beacons into the clock estimate, see syncedClock()
+        */
+        void enableTimeSync();
+
+        /**!
+        * @brief Estimate of the master clock, use slotDue() on it to sample on the same grid as other nodes
+        */
+        timeSync& syncedClock();
+
         /**!
         * @brief Init ESP Now with fallback
         */
@@ -72,7 +281,8 @@ class ESP32Now
         void sendDataAll(String data);
 
         /**!
-        * @brief Sends data from parameter to a single slave from passed mac address
+        * @brief Sends data from parameter to a single slave with matching SSID name. The mac address found by addPeer() or an earlier
+        * send is reused, so only the first send to a name scans WiFi (about 300 ms). Safe to call from another task.
         * @param data of message to send
         * @param Name of device to send to
         */
@@ -0,0 +1,129 @@
+/* Lock-free single producer single consumer ring buffer, used to move received ESP-Now frames out of the WiFi task */
+
+#ifndef ESP32NOWQUEUE_H
+#define ESP32NOWQUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_now.h>
+
+/**!
+ * @brief Copy of one received ESP-Now frame
+ */
+struct espNowFrame
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];          // sender mac address
+    uint8_t length;                         // number of bytes in data, at most ESP_NOW_MAX_DATA_LEN
+    int64_t rxTime;                         // esp_timer_get_time() when the frame was received, used by time sync
+    char data[ESP_NOW_MAX_DATA_LEN + 1];    // frame bytes, always null terminated so it can be used as a string
+};
+
+/**!
+ * @brief Fixed size ring buffer for exactly one producer and one consumer thread, no locks and no heap.
+ * Producer calls writeSlot() then commitWrite(), consumer calls readSlot() then commitRead(), so the
+ * item is filled/used in place without an extra copy.
+ * @tparam T item type
+ * @tparam N number of slots, must be a power of two
+ */
+template <typename T, size_t N>
+class ringBuffer
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "ringBuffer size must be a power of two");
+
+    private:
+        T items[N];
+        std::atomic<uint32_t> head{0}; // next slot to write, only changed by producer
+        std::atomic<uint32_t> tail{0}; // next slot to read, only changed by consumer
+        std::atomic<uint32_t> dropped{0};
+
+    public:
+        /**!
+         * @brief Producer side, get the next free slot
+         * @return Pointer to slot to fill, nullptr if buffer is full (counted as dropped)
+         */
+        T* writeSlot()
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) >= N)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            return &items[h & (N - 1)];
+        }
+
+        /**!
+         * @brief Producer side, publish the slot returned by writeSlot() to the consumer
+         */
+        void commitWrite()
+        {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**!
+         * @brief Consumer side, get the oldest filled slot
+         * @return Pointer to slot to read, nullptr if buffer is empty
+         */
+        T* readSlot()
+        {
+            uint32_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+            return &items[t & (N - 1)];
+        }
+
+        /**!
+         * @brief Consumer side, release the slot returned by readSlot() back to the producer
+         */
+        void commitRead()
+        {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        /**!
+         * @brief Copying versions of the above for small items
+         */
+        bool push(const T& item)
+        {
+            T* slot = writeSlot();
+            if (slot == nullptr)
+            {
+                return false;
+            }
+            *slot = item;
+            commitWrite();
+            return true;
+        }
+
+        bool pop(T& item)
+        {
+            T* slot = readSlot();
+            if (slot == nullptr)
+            {
+                return false;
+            }
+            item = *slot;
+            commitRead();
+            return true;
+        }
+
+        /**!
+         * @return Number of items waiting, only exact when called from producer or consumer
+         */
+        size_t size() const
+        {
+            return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+        }
+
+        /**!
+         * @return Number of writes rejected because buffer was full
+         */
+        uint32_t droppedCount() const
+        {
+            return dropped.load(std::memory_order_relaxed);
+        }
+};
+
+#endif
@@ -0,0 +1,210 @@
+#include "ESP32NowRelay.h"
+
+void relayRouter::begin(uint8_t nodeId)
+{
+    id = nodeId;
+    seq = 0;
+    memset(routes, 0, sizeof(routes));
+    memset(neighbors, 0, sizeof(neighbors));
+    seenCount = 0;
+    seenNext = 0;
+}
+
+uint8_t relayRouter::nodeId()
+{
+    return id;
+}
+
+uint16_t relayRouter::nextSeq()
+{
+    return ++seq;
+}
+
+bool relayRouter::isDuplicate(uint8_t origin, uint16_t frameSeq)
+{
+    for (uint8_t i = 0; i < seenCount; ++i)
+    {
+        if (seen[i].origin == origin && seen[i].seq == frameSeq)
+        {
+            return true;
+        }
+    }
+
+    // overwrite oldest entry once cache is full
+    seen[seenNext].origin = origin;
+    seen[seenNext].seq = frameSeq;
+    seenNext = (seenNext + 1) % RELAY_DUP_CACHE_SIZE;
+    if (seenCount < RELAY_DUP_CACHE_SIZE)
+    {
+        ++seenCount;
+    }
+    return false;
+}
+
+void relayRouter::updateNeighbor(const uint8_t* mac, int8_t rssi)
+{
+    neighbor* slot = nullptr;
+    for (uint8_t i = 0; i < RELAY_MAX_NEIGHBORS; ++i)
+    {
+        if (neighbors[i].used && memcmp(neighbors[i].mac, mac, ESP_NOW_ETH_ALEN) == 0)
+        {
+            slot = &neighbors[i];
+            break;
+        }
+        if (!neighbors[i].used && slot == nullptr)
+        {
+            slot = &neighbors[i];
+        }
+    }
+
+    // table full, replace the weakest neighbor if this one is stronger
+    if (slot == nullptr)
+    {
+        slot = &neighbors[0];
+        for (uint8_t i = 1; i < RELAY_MAX_NEIGHBORS; ++i)
+        {
+            if (neighbors[i].rssi < slot->rssi)
+            {
+                slot = &neighbors[i];
+            }
+        }
+        if (slot->rssi >= rssi)
+        {
+            return;
+        }
+    }
+
+    memcpy(slot->mac, mac, ESP_NOW_ETH_ALEN);
+    slot->rssi = rssi;
+    slot->used = true;
+}
+
+int8_t relayRouter::neighborRssi(const uint8_t* mac)
+{
+    for (uint8_t i = 0; i < RELAY_MAX_NEIGHBORS; ++i)
+    {
+        if (neighbors[i].used && memcmp(neighbors[i].mac, mac, ESP_NOW_ETH_ALEN) == 0)
+        {
+            return neighbors[i].rssi;
+        }
+    }
+    return RELAY_UNKNOWN_RSSI;
+}
+
+int32_t relayRouter::routeCost(const uint8_t* mac, uint8_t hops)
+{
+    // only the first link's signal is known, weak links lose most frames so they cost like extra hops
+    int32_t rssi = neighborRssi(mac);
+    int32_t weakness = rssi < RELAY_RSSI_GOOD ? RELAY_RSSI_GOOD - rssi : 0;
+    return int32_t(hops) * RELAY_HOP_COST + weakness * RELAY_RSSI_WEIGHT;
+}
+
+void relayRouter::learnRoute(uint8_t node, const uint8_t* via, uint8_t hops, unsigned long now)
+{
+    if (node == id || node == RELAY_BROADCAST)
+    {
+        return;
+    }
+
+    route* slot = nullptr;
+    route* oldest = &routes[0];
+    for (uint8_t i = 0; i < RELAY_MAX_ROUTES; ++i)
+    {
+        if (routes[i].used && routes[i].node == node)
+        {
+            slot = &routes[i];
+            break;
+        }
+        if (!routes[i].used && (slot == nullptr || slot->used))
+        {
+            slot = &routes[i];
+        }
+        if (routes[i].updated < oldest->updated)
+        {
+            oldest = &routes[i];
+        }
+    }
+    if (slot == nullptr)
+    {
+        slot = oldest;
+    }
+
+    if (slot->used && slot->node == node)
+    {
+        bool stale = now - slot->updated > RELAY_ROUTE_TIMEOUT;
+        bool sameHop = memcmp(slot->nextHop, via, ESP_NOW_ETH_ALEN) == 0;
+        if (!stale && !sameHop && routeCost(via, hops) >= routeCost(slot->nextHop, slot->hops))
+        {
+            return;
+        }
+    }
+
+    slot->node = node;
+    memcpy(slot->nextHop, via, ESP_NOW_ETH_ALEN);
+    slot->hops = hops;
+    slot->updated = now;
+    slot->used = true;
+}
+
+uint8_t relayRouter::receive(relayHeader& header, const uint8_t* from, unsigned long now)
+{
+    if (header.origin == id)
+    {
+        return 0;
+    }
+
+    // the neighbor that handed us this frame is a way back to the origin, learn it even from duplicates
+    learnRoute(header.origin, from, header.hops + 1, now);
+    if (isDuplicate(header.origin, header.seq))
+    {
+        return 0;
+    }
+
+    uint8_t action = 0;
+    if (header.dest != id && header.ttl > 1)
+    {
+        header.ttl--;
+        header.hops++;
+        action |= RELAY_FORWARD;
+    }
+    if (header.dest == id || header.dest == RELAY_BROADCAST)
+    {
+        action |= RELAY_DELIVER;
+    }
+    return action;
+}
+
+const uint8_t* relayRouter::nextHop(uint8_t node, unsigned long now)
+{
+    if (node == RELAY_BROADCAST)
+    {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < RELAY_MAX_ROUTES; ++i)
+    {
+        if (routes[i].used && routes[i].node == node)
+        {
+            if (now - routes[i].updated > RELAY_ROUTE_TIMEOUT)
+            {
+                return nullptr;
+            }
+            return routes[i].nextHop;
+        }
+    }
+    return nullptr;
+}
+
+void relayRouter::printRoutes(Print* port, unsigned long now)
+{
+    char line[80];
+    for (uint8_t i = 0; i < RELAY_MAX_ROUTES; ++i)
+    {
+        if (routes[i].used)
+        {
+            const uint8_t* m = routes[i].nextHop;
+            snprintf(line, sizeof(line), "Node %u via %02x:%02x:%02x:%02x:%02x:%02x, %u hops, age %lus",
+                     routes[i].node, m[0], m[1], m[2], m[3], m[4], m[5], routes[i].hops, (now - routes[i].updated) / 1000);
+            port->println(line);
+        }
+    }
+}
@@ -0,0 +1,176 @@
+/* Routing for optional multi-hop relay mode, lets frames reach nodes beyond single hop ESP-Now range */
+
+#ifndef ESP32NOWRELAY_H
+#define ESP32NOWRELAY_H
+
+#include <Arduino.h>
+#include <esp_now.h>
+
+// First byte of every relay frame, not printable so it never clashes with text commands like "PUMPON"
+#define RELAY_MAGIC 0xA5
+
+// Destination id that every node delivers
+#define RELAY_BROADCAST 0xFF
+
+// Hops a frame may travel before it is dropped
+#define RELAY_DEFAULT_TTL 4
+
+// Number of nodes the routing table can hold
+#define RELAY_MAX_ROUTES 16
+
+// Number of neighbors with known signal strength
+#define RELAY_MAX_NEIGHBORS 8
+
+// Number of recent (origin, seq) pairs remembered to drop duplicate copies of flooded frames
+#define RELAY_DUP_CACHE_SIZE 16
+
+// Routes not refreshed for this long are ignored and the destination is flooded again, in milliseconds
+#define RELAY_ROUTE_TIMEOUT 120000
+
+// Cost of each hop when picking a next hop, see RELAY_RSSI_WEIGHT for what a weak first link adds
+#define RELAY_HOP_COST 100
+
+// First links at or above this RSSI add no cost, in dBm
+#define RELAY_RSSI_GOOD -50
+
+// Cost added per dB the first link is below RELAY_RSSI_GOOD, 25 dB weaker costs as much as one more hop.
+// A direct link at -90 dBm (cost 260) then loses to 2 hops with a -30 dBm first link (cost 200).
+#define RELAY_RSSI_WEIGHT 4
+
+// RSSI used for next hops that were never seen in a scan
+#define RELAY_UNKNOWN_RSSI -90
+
+/**!
+ * @brief Header in front of every relayed frame
+ */
+struct __attribute__((packed)) relayHeader
+{
+    uint8_t magic;  // RELAY_MAGIC
+    uint8_t origin; // node id that first sent the frame
+    uint8_t dest;   // node id to deliver to, RELAY_BROADCAST for all nodes
+    uint8_t ttl;    // hops left, frame is not forwarded once this reaches 1
+    uint8_t hops;   // hops travelled so far
+    uint16_t seq;   // sequence number per origin, for duplicate suppression
+};
+
+// Flags returned by relayRouter::receive()
+#define RELAY_FORWARD 0x01 // send the frame on with the updated header
+#define RELAY_DELIVER 0x02 // frame is for this node, hand the payload to the command handlers
+
+// Largest payload that fits in one relayed frame
+#define RELAY_MAX_PAYLOAD (ESP_NOW_MAX_DATA_LEN - sizeof(relayHeader))
+
+/**!
+ * @brief Routing table, neighbor signal strength and duplicate cache for relay mode. Only bookkeeping, sending is done by ESP32Now.
+ */
+class relayRouter
+{
+    private:
+        struct route
+        {
+            uint8_t node;
+            uint8_t nextHop[ESP_NOW_ETH_ALEN];
+            uint8_t hops;
+            unsigned long updated;
+            bool used;
+        };
+
+        struct neighbor
+        {
+            uint8_t mac[ESP_NOW_ETH_ALEN];
+            int8_t rssi;
+            bool used;
+        };
+
+        struct seenFrame
+        {
+            uint8_t origin;
+            uint16_t seq;
+        };
+
+        uint8_t id = 0;
+        uint16_t seq = 0;
+        route routes[RELAY_MAX_ROUTES] = {};
+        neighbor neighbors[RELAY_MAX_NEIGHBORS] = {};
+        seenFrame seen[RELAY_DUP_CACHE_SIZE] = {};
+        uint8_t seenCount = 0;
+        uint8_t seenNext = 0;
+
+        /**!
+         * @brief Cost of reaching a node through next hop mac with given hop count, lower is better
+         */
+        int32_t routeCost(const uint8_t* mac, uint8_t hops);
+
+    public:
+        /**!
+         * @brief Set this node's id and clear all tables
+         * @param nodeId id of this node, must be unique and not RELAY_BROADCAST
+         */
+        void begin(uint8_t nodeId);
+
+        /**!
+         * @return This node's id
+         */
+        uint8_t nodeId();
+
+        /**!
+         * @return Sequence number for the next frame this node sends
+         */
+        uint16_t nextSeq();
+
+        /**!
+         * @brief Check if frame was already seen, and remember it if not
+         * @param origin node id that sent the frame
+         * @param seq sequence number of frame
+         * @return true if it is a duplicate and should be dropped
+         */
+        bool isDuplicate(uint8_t origin, uint16_t seq);
+
+        /**!
+         * @brief Record signal strength of a neighbor, from the RSSI found when scanning
+         * @param mac neighbor mac address
+         * @param rssi signal strength in dBm
+         */
+        void updateNeighbor(const uint8_t* mac, int8_t rssi);
+
+        /**!
+         * @brief Look up signal strength of a neighbor
+         * @return RSSI in dBm, RELAY_UNKNOWN_RSSI if never seen
+         */
+        int8_t neighborRssi(const uint8_t* mac);
+
+        /**!
+         * @brief Learn the reverse path from a received frame, the origin can be reached through the neighbor that handed us the frame.
+         * Kept only if it is cheaper than the current route or the current route is stale or uses the same next hop.
+         * @param node origin of frame
+         * @param via mac address of neighbor the frame came from
+         * @param hops hops to the origin through that neighbor
+         * @param now current millis()
+         */
+        void learnRoute(uint8_t node, const uint8_t* via, uint8_t hops, unsigned long now);
+
+        /**!
+         * @brief Decide what to do with a received relay frame. Learns the route back to the origin from every copy, then drops
+         * duplicates, so a copy that arrives later over a better path still improves the route.
+         * @param header header of received frame, ttl and hops are updated when the frame is to be forwarded
+         * @param from mac address of neighbor the frame came from
+         * @param now current millis()
+         * @return RELAY_FORWARD and/or RELAY_DELIVER, 0 to drop the frame
+         */
+        uint8_t receive(relayHeader& header, const uint8_t* from, unsigned long now);
+
+        /**!
+         * @brief Next hop towards a node
+         * @param node destination node id
+         * @param now current millis()
+         * @return mac address of next hop, nullptr if no fresh route and the frame should be flooded
+         */
+        const uint8_t* nextHop(uint8_t node, unsigned long now);
+
+        /**!
+         * @brief Prints routing table to serial port
+         */
+        void printRoutes(Print* port, unsigned long now);
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "ESP32NowTimeSync.h"
+#include <esp_timer.h>
+
+static_assert(TIMESYNC_MAX_OUTLIERS <= TIMESYNC_WINDOW, "agreeing outliers have to fit the window they replace");
+
+bool timeSync::addBeacon(int64_t masterTime, int64_t localTime)
+{
+    sample beacon = {localTime, masterTime - localTime};
+    if (count >= 1)
+    {
+        int64_t error = masterTime - toMaster(snapshot(), localTime);
+        if (error > TIMESYNC_OUTLIER_US || error < -TIMESYNC_OUTLIER_US)
+        {
+            // a beacon stuck in a busy WiFi task arrives late, skip it but keep it in case the master clock really jumped
+            int64_t spread = candidateCount > 0 ? beacon.offset - candidates[0].offset : 0;
+            if (spread > TIMESYNC_OUTLIER_US || spread < -TIMESYNC_OUTLIER_US)
+            {
+                candidateCount = 0;
+            }
+            candidates[candidateCount++] = beacon;
+            if (candidateCount < TIMESYNC_MAX_OUTLIERS)
+            {
+                return false;
+            }
+
+            // they keep agreeing with each other (eg. master rebooted), restart from them, drift of the local clock stays the same
+            memcpy(samples, candidates, sizeof(candidates));
+            count = TIMESYNC_MAX_OUTLIERS;
+            next = count % TIMESYNC_WINDOW;
+            candidateCount = 0;
+            fit(true);
+            return true;
+        }
+    }
+    candidateCount = 0;
+
+    // overwrite oldest sample once window is full
+    samples[next] = beacon;
+    next = (next + 1) % TIMESYNC_WINDOW;
+    if (count < TIMESYNC_WINDOW)
+    {
+        ++count;
+    }
+    fit(false);
+    return true;
+}
+
+void timeSync::fit(bool restart)
+{
+    // only this task writes the estimate, so the last drift can be read without the lock
+    model fitted = estimate;
+
+    // fit relative to the newest sample so the numbers stay small
+    const sample& newest = samples[(next + TIMESYNC_WINDOW - 1) % TIMESYNC_WINDOW];
+    int64_t localRef = newest.local;
+    int64_t offsetRef = newest.offset;
+
+    double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        double x = double(samples[i].local - localRef);
+        double y = double(samples[i].offset - offsetRef);
+        sumX += x;
+        sumY += y;
+        sumXX += x * x;
+        sumXY += x * y;
+    }
+
+    // a slope from two or three beacons is mostly their delay jitter, keep the last one until there are enough
+    double denominator = count * sumXX - sumX * sumX;
+    if (count >= TIMESYNC_MIN_DRIFT_SAMPLES && denominator != 0)
+    {
+        fitted.slope = (count * sumXY - sumX * sumY) / denominator;
+    }
+    fitted.intercept = (sumY - fitted.slope * sumX) / count;
+    fitted.localRef = localRef;
+    fitted.offsetRef = offsetRef;
+    fitted.samples = count;
+
+    // publish the whole model at once, a reader in another task never sees half of it
+    portENTER_CRITICAL(&lock);
+    estimate = fitted;
+    if (restart)
+    {
+        lastSlot = -1;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+timeSync::model timeSync::snapshot()
+{
+    portENTER_CRITICAL(&lock);
+    model fitted = estimate;
+    portEXIT_CRITICAL(&lock);
+    return fitted;
+}
+
+int64_t timeSync::toMaster(const model& fitted, int64_t localTime)
+{
+    double elapsed = double(localTime - fitted.localRef);
+    return localTime + fitted.offsetRef + int64_t(fitted.intercept + fitted.slope * elapsed);
+}
+
+bool timeSync::synced()
+{
+    return snapshot().samples >= 2;
+}
+
+int64_t timeSync::toMaster(int64_t localTime)
+{
+    return toMaster(snapshot(), localTime);
+}
+
+int64_t timeSync::toLocal(const model& fitted, int64_t masterTime)
+{
+    // invert toMaster(), master = localRef + offsetRef + intercept + (local - localRef) * (1 + slope)
+    double elapsed = (double(masterTime - fitted.localRef - fitted.offsetRef) - fitted.intercept) / (1 + fitted.slope);
+    return fitted.localRef + int64_t(elapsed);
+}
+
+int64_t timeSync::toLocal(int64_t masterTime)
+{
+    return toLocal(snapshot(), masterTime);
+}
+
+int64_t timeSync::masterNow()
+{
+    return toMaster(esp_timer_get_time());
+}
+
+float timeSync::driftPpm()
+{
+    return float(snapshot().slope * 1e6);
+}
+
+int64_t timeSync::microsUntilSlot(uint32_t periodMs)
+{
+    int64_t period = int64_t(periodMs) * 1000;
+    model fitted = snapshot();
+    int64_t now = esp_timer_get_time();
+    int64_t nextSlot = (toMaster(fitted, now) / period + 1) * period;
+    return toLocal(fitted, nextSlot) - now;
+}
+
+bool timeSync::slotDue(uint32_t periodMs)
+{
+    model fitted = snapshot();
+    if (fitted.samples < 2)
+    {
+        return false;
+    }
+
+    int64_t slot = toMaster(fitted, esp_timer_get_time()) / (int64_t(periodMs) * 1000);
+    bool due = false;
+    portENTER_CRITICAL(&lock);
+    if (lastSlot < 0)
+    {
+        // first call only lines up with the grid, the next crossing is the first sample
+        lastSlot = slot;
+    }
+    else if (slot != lastSlot)
+    {
+        lastSlot = slot;
+        due = true;
+    }
+    portEXIT_CRITICAL(&lock);
+    return due;
+}
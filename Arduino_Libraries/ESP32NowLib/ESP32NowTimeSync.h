@@ -0,0 +1,129 @@
+/* Clock sync for slaves from master time beacons, so sensor nodes can sample on a shared grid */
+
+#ifndef ESP32NOWTIMESYNC_H
+#define ESP32NOWTIMESYNC_H
+
+#include <Arduino.h>
+
+// Command word of time beacons broadcast by the master, "SYNC <master time in us>"
+#define TIMESYNC_COMMAND "SYNC"
+
+// Number of recent beacons used to estimate offset and drift
+#define TIMESYNC_WINDOW 8
+
+// Once synced, beacons that disagree with the estimate by more than this are treated as delayed and skipped, in microseconds
+#define TIMESYNC_OUTLIER_US 5000
+
+// After this many skipped beacons in a row that agree with each other the estimate is assumed wrong (eg. master rebooted) and
+// restarted from them, delayed beacons rarely come this many in a row and late by the same amount
+#define TIMESYNC_MAX_OUTLIERS 5
+
+// Drift is only fitted from this many beacons on, fewer only update the offset and keep the last drift
+#define TIMESYNC_MIN_DRIFT_SAMPLES 4
+
+/**!
+ * @brief Estimates the master clock from beacons. Keeps the last TIMESYNC_WINDOW (local receive time, master time) pairs and fits
+ * offset and drift with least squares, so lost beacons only shorten the window. Beacons far off the estimate are held back as
+ * candidates, the estimate is kept until TIMESYNC_MAX_OUTLIERS of them agree. All times are esp_timer_get_time() microseconds,
+ * which don't wrap. Every slave receives the same broadcast at nearly the same moment, so the unknown air delay is common to all
+ * slaves and cancels out of their alignment.
+ * addBeacon() is called from one task (ESP32Now calls it from dispatch()), the other calls are safe from any task.
+ */
+class timeSync
+{
+    private:
+        struct sample
+        {
+            int64_t local;
+            int64_t offset; // master - local
+        };
+
+        sample samples[TIMESYNC_WINDOW];
+        uint8_t count = 0;
+        uint8_t next = 0;
+
+        // skipped beacons in a row that agree with each other, replace the window once there are TIMESYNC_MAX_OUTLIERS
+        sample candidates[TIMESYNC_MAX_OUTLIERS];
+        uint8_t candidateCount = 0;
+
+        // fitted model, offset(t) = offsetRef + intercept + slope * (t - localRef)
+        struct model
+        {
+            int64_t localRef;
+            int64_t offsetRef;
+            double intercept;
+            double slope;
+            uint8_t samples;    // beacons it was fitted from
+        };
+
+        // estimate and lastSlot are written by the task adding beacons and read from others, only copied under the lock
+        model estimate = {};
+        int64_t lastSlot = -1;
+        portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+        /**!
+         * @brief Refits offset and drift over the samples in the window, only the offset below TIMESYNC_MIN_DRIFT_SAMPLES
+         * @param restart true to line slotDue() up with the grid again
+         */
+        void fit(bool restart);
+
+        /**!
+         * @return Copy of the estimate taken under the lock
+         */
+        model snapshot();
+
+        /**!
+         * @brief toMaster() and toLocal() with a given estimate, so a caller converting both ways uses the same one
+         */
+        static int64_t toMaster(const model& fitted, int64_t localTime);
+        static int64_t toLocal(const model& fitted, int64_t masterTime);
+
+    public:
+        /**!
+         * @brief Add one beacon
+         * @param masterTime master clock in the beacon
+         * @param localTime local clock when the beacon was received (ESP32Now stamps this in the receive callback)
+         * @return false if beacon was skipped as an outlier (it may still restart the estimate later, with the ones after it)
+         */
+        bool addBeacon(int64_t masterTime, int64_t localTime);
+
+        /**!
+         * @return true once at least two beacons were received
+         */
+        bool synced();
+
+        /**!
+         * @brief Converts local time to master time
+         */
+        int64_t toMaster(int64_t localTime);
+
+        /**!
+         * @brief Converts master time to local time
+         */
+        int64_t toLocal(int64_t masterTime);
+
+        /**!
+         * @return Current master time estimate
+         */
+        int64_t masterNow();
+
+        /**!
+         * @return Estimated drift of local clock against master, in parts per million
+         */
+        float driftPpm();
+
+        /**!
+         * @brief Microseconds until the next point of the shared sampling grid (multiples of period in master time)
+         * @param periodMs grid period in milliseconds
+         */
+        int64_t microsUntilSlot(uint32_t periodMs);
+
+        /**!
+         * @brief Returns true once per grid period when the master time crosses the next grid point, poll it often from loop().
+         * Returns false until synced.
+         * @param periodMs grid period in milliseconds, use the same value on every node
+         */
+        bool slotDue(uint32_t periodMs);
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "ESP32NowLib.h"
+
+/*
+ Relay node example. Flash this on nodes placed between the master and slaves that are out of direct range.
+ Every node (master, relays, slaves) calls enableRelay() with its own unique id, relays forward frames for others
+ and also handle the ones sent to them.
+*/
+
+// Unique id of this node, master uses 0 in this example
+#define NODE_ID 2
+
+// Create ESP32 node
+ESP32Now espNode(1);
+
+// millis variable for rescanning neighbors every x seconds without using delay
+unsigned long previous_scan_millis = 0;
+const long scan_interval = 60000;
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("ESPNow Relay Example");
+
+    // Relay nodes are slaves too so others can find them by SSID
+    espNode.ESPNowStartSlave("Slave Relay 2");
+    espNode.addHandler("PUMPON", onPumpOn);
+
+    // Turn on relay mode and find neighbors, their RSSI is used to pick the next hop
+    espNode.enableRelay(NODE_ID);
+    espNode.scanNeighbors("Slave");
+
+    // Forwarding happens in the dispatch task
+    espNode.startDispatchTask();
+}
+
+void loop() {
+    // signal strength changes, so rescan now and then
+    unsigned long current_millis = millis();
+    if (current_millis - previous_scan_millis >= scan_interval)
+    {
+        previous_scan_millis = current_millis;
+        espNode.scanNeighbors("Slave");
+        espNode.printRoutes();
+    }
+}
+
+void onPumpOn(const uint8_t *mac_addr, const char *args)
+{
+    Serial.print("Command to turn on pump from node "); Serial.println(espNode.relayOrigin());
+}
\ No newline at end of file
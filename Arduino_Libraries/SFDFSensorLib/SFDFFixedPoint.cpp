@@ -0,0 +1,91 @@
+#include "SFDFFixedPoint.h"
+
+size_t formatFixed(char* buffer, size_t size, fixedValue value)
+{
+    if (!value.valid)
+    {
+        if (size < 5)
+        {
+            return 0;
+        }
+        memcpy(buffer, "null", 5);
+        return 4;
+    }
+
+    // raw fits in 10 digits, so more than 9 decimals would overflow the scratch buffer
+    if (value.decimals > 9)
+    {
+        return 0;
+    }
+
+    // write digits backwards into a scratch buffer, then copy out in order
+    char digits[FIXED_VALUE_STR_LEN];
+    size_t count = 0;
+    bool negative = value.raw < 0;
+    uint32_t magnitude = negative ? uint32_t(0) - uint32_t(value.raw) : uint32_t(value.raw);
+
+    do
+    {
+        digits[count++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+        // pad with zeros so there is always at least one digit in front of the decimal point (eg. 5 with 3 decimals -> 0.005)
+    } while (magnitude > 0 || count <= value.decimals);
+
+    size_t length = count + (negative ? 1 : 0) + (value.decimals > 0 ? 1 : 0);
+    if (length + 1 > size)
+    {
+        return 0;
+    }
+
+    size_t pos = 0;
+    if (negative)
+    {
+        buffer[pos++] = '-';
+    }
+    while (count > 0)
+    {
+        if (count == value.decimals)
+        {
+            buffer[pos++] = '.';
+        }
+        buffer[pos++] = digits[--count];
+    }
+    buffer[pos] = 0;
+
+    return pos;
+}
+
+double fixedToDouble(fixedValue value)
+{
+    double result = value.raw;
+    for (uint8_t i = 0; i < value.decimals; ++i)
+    {
+        result /= 10;
+    }
+    return result;
+}
+
+fixedValue averageFixed(const fixedValue* values, size_t count)
+{
+    fixedValue result = {0, 0, false};
+    int64_t sum = 0;
+    int32_t valid = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (values[i].valid)
+        {
+            sum += values[i].raw;
+            result.decimals = values[i].decimals;
+            ++valid;
+        }
+    }
+
+    if (valid > 0)
+    {
+        // round half away from zero
+        result.raw = int32_t((sum >= 0 ? sum + valid / 2 : sum - valid / 2) / valid);
+        result.valid = true;
+    }
+    return result;
+}
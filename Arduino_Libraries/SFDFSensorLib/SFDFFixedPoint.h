@@ -0,0 +1,47 @@
+#ifndef SFDFFIXEDPOINT_H
+#define SFDFFIXEDPOINT_H
+
+#include <Arduino.h>
+
+/**!
+ * @brief Fixed-point sensor value, the raw register value plus how many decimal places it is scaled by.
+ * Actual value is raw / 10^decimals (eg. pH register 712 with 2 decimals is 7.12). The ESP32 has no
+ * double-precision FPU, so keep values in this form all the way to the JSON message instead of using double.
+ */
+struct fixedValue
+{
+    int32_t raw;      // raw register value
+    uint8_t decimals; // number of decimal places, value = raw / 10^decimals
+    bool valid;       // false if the Modbus read failed
+};
+
+// Longest string formatFixed() can write: sign, 10 digits, decimal point and null terminator
+#define FIXED_VALUE_STR_LEN 13
+
+/**!
+ * @brief Formats a fixed-point value as a decimal string using integer math only (eg. {712, 2} -> "7.12").
+ * An invalid value is formatted as "null" so it can be put straight into a JSON message.
+ * @param buffer Output buffer, should be at least FIXED_VALUE_STR_LEN long
+ * @param size Size of output buffer
+ * @param value Value to format
+ * @return Number of characters written not including null terminator, 0 if buffer too small
+ */
+size_t formatFixed(char* buffer, size_t size, fixedValue value);
+
+/**!
+ * @brief Converts a fixed-point value to double, only use this for printing/debugging.
+ * @param value Value to convert
+ * @return Value as double
+ */
+double fixedToDouble(fixedValue value);
+
+/**!
+ * @brief Averages several fixed-point values with integer math, rounding to nearest. Invalid values are skipped.
+ * All values must have the same number of decimals.
+ * @param values Array of values to average
+ * @param count Number of values in array
+ * @return Averaged value, invalid if no valid values were passed
+ */
+fixedValue averageFixed(const fixedValue* values, size_t count);
+
+#endif
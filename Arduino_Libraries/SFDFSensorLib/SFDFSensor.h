@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include <ModbusMaster.h>
+#include "SFDFFixedPoint.h"
+#include "SFDFTelemetry.h"
 
 class sensorNodes
 {
@@ -51,7 +53,48 @@ class sensorNodes
          * @return Value of sensor data
          */
         double readValue(ModbusMaster* node, uint16_t u16ReadAddress);
-        
+
+        /* Fixed-point versions of the above, returns raw register value with its scale instead of converting to double */
+
+        /**!
+         * @brief Reads the EC value from the sensor register without converting to double, unit in uS/cm
+         * @return Returns EC value in uS/cm with 0 decimals.
+         */
+        fixedValue readECFixed();
+
+        /**!
+         * @brief Reads the temperature from the sensor register without converting to double, unit in celsius
+         * @return Temperature in celsius with 2 decimals.
+         */
+        fixedValue readTemperatureFixed();
+
+        /**!
+         * @brief Reads the disolved oxygen value from the sensor register without converting to double, unit in mg/L
+         * @return Returns the disolved oxygen value in mg/L with 3 decimals.
+         */
+        fixedValue readDOFixed();
+
+        /**!
+         * @brief Reads the pH value from the sensor register without converting to double, unit in pH.
+         * @return Returns pH value with 2 decimals.
+         */
+        fixedValue readPhFixed();
+
+        /**!
+         * @brief General function for reading one holding register from a Modbus sensor slave as a fixed-point value.
+         * @param ModbusMaster object that you wish to use/read from.
+         * @param u16ReadAddress address of the holding register (0x0000..0xFFFF)
+         * @param decimals number of decimal places the sensor scales the register by (eg. 2 if register 712 means 7.12)
+         * @return Value of sensor data, with valid set to false if the read failed
+         */
+        fixedValue readValueFixed(ModbusMaster* node, uint16_t u16ReadAddress, uint8_t decimals);
+
+        /**!
+         * @brief Reads all four sensors as fixed-point, eg. to send to the master with encodeTelemetry() or add to a telemetryAggregator
+         * @return Readings of pH, EC, DO and temperature
+         */
+        sensorReading readAll();
+
 };
 
 
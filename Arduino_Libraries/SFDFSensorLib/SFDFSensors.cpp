@@ -1,4 +1,5 @@
 #include "SFDFSensor.h"
+#include <SFDFTrace.h>
 
 
 sensorNodes::sensorNodes(ModbusMaster* node_ec,ModbusMaster* node_ph,ModbusMaster* node_do)
@@ -6,6 +7,7 @@ sensorNodes::sensorNodes(ModbusMaster* node_ec,ModbusMaster* node_ph,ModbusMaste
 
 double sensorNodes::readDO()
 {
+    SFDF_TRACE_SCOPE("modbus_read");
     double value_do;
     uint16_t result = node_do->readHoldingRegisters (0x30, 0x01);
     if (result == node_do->ku8MBSuccess)
@@ -19,6 +21,7 @@ double sensorNodes::readDO()
 
 double sensorNodes::readEC()
 {
+    SFDF_TRACE_SCOPE("modbus_read");
     double value_ec;
     uint16_t result = node_ec->readHoldingRegisters (0x00, 0x01);
     if (result == node_ec->ku8MBSuccess)
@@ -32,6 +35,7 @@ double sensorNodes::readEC()
 
 double sensorNodes::readPh()
 {
+    SFDF_TRACE_SCOPE("modbus_read");
     double value_ph;
     uint16_t result = node_ph->readHoldingRegisters (0x09, 0x01);
     if (result == node_ph->ku8MBSuccess)
@@ -45,6 +49,7 @@ double sensorNodes::readPh()
 
 double sensorNodes::readTemperature()
 {
+    SFDF_TRACE_SCOPE("modbus_read");
     double value_temp;
     uint16_t result = node_do->readHoldingRegisters (0x2B, 0x01);
     if (result == node_do->ku8MBSuccess)
@@ -58,6 +63,7 @@ double sensorNodes::readTemperature()
 
 double sensorNodes::readValue(ModbusMaster* node, uint16_t u16ReadAddress)
 {
+    SFDF_TRACE_SCOPE("modbus_read");
     double value = 0;
     uint16_t result = node->readHoldingRegisters(u16ReadAddress,1);
     if (result == node->ku8MBSuccess)
@@ -65,4 +71,47 @@ double sensorNodes::readValue(ModbusMaster* node, uint16_t u16ReadAddress)
         value = double(node->getResponseBuffer(0))/100;
     }
     return value;
-}
\ No newline at end of file
+}
+
+fixedValue sensorNodes::readDOFixed()
+{
+    return readValueFixed(node_do, 0x30, 3);
+}
+
+fixedValue sensorNodes::readECFixed()
+{
+    return readValueFixed(node_ec, 0x00, 0);
+}
+
+fixedValue sensorNodes::readPhFixed()
+{
+    return readValueFixed(node_ph, 0x09, 2);
+}
+
+fixedValue sensorNodes::readTemperatureFixed()
+{
+    return readValueFixed(node_do, 0x2B, 2);
+}
+
+fixedValue sensorNodes::readValueFixed(ModbusMaster* node, uint16_t u16ReadAddress, uint8_t decimals)
+{
+    SFDF_TRACE_SCOPE("modbus_read");
+    fixedValue value = {0, decimals, false};
+    uint8_t result = node->readHoldingRegisters(u16ReadAddress, 1);
+    if (result == node->ku8MBSuccess)
+    {
+        value.raw = node->getResponseBuffer(0);
+        value.valid = true;
+    }
+    return value;
+}
+
+sensorReading sensorNodes::readAll()
+{
+    sensorReading reading;
+    reading.ph = readPhFixed();
+    reading.ec = readECFixed();
+    reading.do_data = readDOFixed();
+    reading.temperature = readTemperatureFixed();
+    return reading;
+}
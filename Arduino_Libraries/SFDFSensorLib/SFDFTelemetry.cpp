@@ -0,0 +1,253 @@
+#include "SFDFTelemetry.h"
+
+// Decimals of each field in a telemetry frame, in frame order pH, EC, DO, Temp
+static const uint8_t TELEMETRY_DECIMALS[4] = {2, 0, 3, 2};
+
+// Longest JSON object for one node in a batch
+#define TELEMETRY_NODE_JSON_LEN 128
+
+static size_t appendRaw(char* buffer, size_t size, fixedValue value)
+{
+    int written = value.valid ? snprintf(buffer, size, " %ld", (long)value.raw) : snprintf(buffer, size, " -");
+    return (written < 0 || (size_t)written >= size) ? 0 : written;
+}
+
+size_t encodeTelemetry(char* buffer, size_t size, uint8_t nodeId, const sensorReading& reading)
+{
+    const fixedValue* fields[4] = {&reading.ph, &reading.ec, &reading.do_data, &reading.temperature};
+
+    int written = snprintf(buffer, size, TELEMETRY_COMMAND " %u", nodeId);
+    if (written < 0 || (size_t)written >= size)
+    {
+        return 0;
+    }
+    size_t length = written;
+
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        size_t added = appendRaw(buffer + length, size - length, *fields[i]);
+        if (added == 0)
+        {
+            return 0;
+        }
+        length += added;
+    }
+    return length;
+}
+
+bool decodeTelemetry(const char* args, uint8_t& nodeId, sensorReading& reading)
+{
+    fixedValue* fields[4] = {&reading.ph, &reading.ec, &reading.do_data, &reading.temperature};
+    char* end;
+
+    long id = strtol(args, &end, 10);
+    if (end == args || id < 0 || id > 255)
+    {
+        return false;
+    }
+    nodeId = (uint8_t)id;
+
+    const char* pos = end;
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        while (*pos == ' ')
+        {
+            ++pos;
+        }
+
+        fields[i]->decimals = TELEMETRY_DECIMALS[i];
+        if (*pos == '-' && (pos[1] == ' ' || pos[1] == 0))
+        {
+            fields[i]->raw = 0;
+            fields[i]->valid = false;
+            ++pos;
+            continue;
+        }
+
+        long raw = strtol(pos, &end, 10);
+        if (end == pos)
+        {
+            return false;
+        }
+        fields[i]->raw = (int32_t)raw;
+        fields[i]->valid = true;
+        pos = end;
+    }
+    return true;
+}
+
+bool telemetryAggregator::add(uint8_t nodeId, const sensorReading& reading)
+{
+    portENTER_CRITICAL(&lock);
+    nodeEntry* entry = nullptr;
+    for (uint8_t i = 0; i < TELEMETRY_MAX_NODES; ++i)
+    {
+        if (nodes[i].used && nodes[i].nodeId == nodeId)
+        {
+            entry = &nodes[i];
+            break;
+        }
+        if (!nodes[i].used && entry == nullptr)
+        {
+            entry = &nodes[i];
+        }
+    }
+    if (entry == nullptr)
+    {
+        portEXIT_CRITICAL(&lock);
+        return false;
+    }
+    if (!entry->used)
+    {
+        memset(entry, 0, sizeof(nodeEntry));
+        entry->nodeId = nodeId;
+        entry->used = true;
+    }
+
+    const fixedValue* fields[4] = {&reading.ph, &reading.ec, &reading.do_data, &reading.temperature};
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        if (fields[i]->valid)
+        {
+            entry->sum[i] += fields[i]->raw;
+            entry->count[i]++;
+            entry->decimals[i] = fields[i]->decimals;
+        }
+    }
+    entry->samples++;
+    portEXIT_CRITICAL(&lock);
+    return true;
+}
+
+size_t telemetryAggregator::pendingNodes()
+{
+    size_t pending = 0;
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < TELEMETRY_MAX_NODES; ++i)
+    {
+        if (nodes[i].used && nodes[i].samples > 0)
+        {
+            ++pending;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return pending;
+}
+
+fixedValue telemetryAggregator::average(const nodeEntry& entry, uint8_t field)
+{
+    fixedValue value = {0, entry.decimals[field], false};
+    int64_t count = entry.count[field];
+    if (count > 0)
+    {
+        int64_t sum = entry.sum[field];
+        // round half away from zero, same as averageFixed()
+        value.raw = int32_t((sum >= 0 ? sum + count / 2 : sum - count / 2) / count);
+        value.valid = true;
+    }
+    return value;
+}
+
+size_t telemetryAggregator::buildBatch(char* buffer, size_t size, const char* time)
+{
+    static const char* names[4] = {"pH", "EC", "DO", "Temp"};
+    static const char closing[] = "]}";
+
+    // a batch that was never committed is built again from the start, from a copy so add() isn't held up by the formatting
+    nodeEntry snapshot[TELEMETRY_MAX_NODES];
+    size_t pending = 0;
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < TELEMETRY_MAX_NODES; ++i)
+    {
+        nodes[i].inBatch = false;
+        pending += nodes[i].used && nodes[i].samples > 0;
+    }
+    memcpy(snapshot, nodes, sizeof(nodes));
+    portEXIT_CRITICAL(&lock);
+    if (pending == 0)
+    {
+        return 0;
+    }
+
+    int written = snprintf(buffer, size, "{\"DateTime\":\"%s\",\"nodes\":[", time);
+    if (written < 0 || (size_t)written + sizeof(closing) > size)
+    {
+        return 0;
+    }
+    size_t length = written;
+    size_t added = 0;
+
+    for (uint8_t i = 0; i < TELEMETRY_MAX_NODES; ++i)
+    {
+        nodeEntry& entry = snapshot[i];
+        if (!entry.used || entry.samples == 0)
+        {
+            continue;
+        }
+
+        // format node object on its own first so a node is never cut in half
+        char object[TELEMETRY_NODE_JSON_LEN];
+        size_t objectLen = snprintf(object, sizeof(object), "%s{\"node\":%u", added > 0 ? "," : "", entry.nodeId);
+        for (uint8_t field = 0; field < 4; ++field)
+        {
+            char value[FIXED_VALUE_STR_LEN];
+            formatFixed(value, sizeof(value), average(entry, field));
+            objectLen += snprintf(object + objectLen, sizeof(object) - objectLen, ",\"%s\":%s", names[field], value);
+        }
+        objectLen += snprintf(object + objectLen, sizeof(object) - objectLen, "}");
+
+        if (length + objectLen + sizeof(closing) > size)
+        {
+            // leave the rest for the next batch
+            break;
+        }
+        memcpy(buffer + length, object, objectLen);
+        length += objectLen;
+        ++added;
+        entry.inBatch = true;
+    }
+
+    if (added == 0)
+    {
+        return 0;
+    }
+
+    // remember what went into this batch, a node's slot never moves so the copy's index is the node's
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < TELEMETRY_MAX_NODES; ++i)
+    {
+        if (snapshot[i].inBatch)
+        {
+            nodeEntry& entry = nodes[i];
+            entry.inBatch = true;
+            entry.batchSamples = snapshot[i].samples;
+            memcpy(entry.batchSum, snapshot[i].sum, sizeof(entry.batchSum));
+            memcpy(entry.batchCount, snapshot[i].count, sizeof(entry.batchCount));
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+
+    memcpy(buffer + length, closing, sizeof(closing));
+    return length + sizeof(closing) - 1;
+}
+
+void telemetryAggregator::commitBatch()
+{
+    portENTER_CRITICAL(&lock);
+    for (uint8_t i = 0; i < TELEMETRY_MAX_NODES; ++i)
+    {
+        nodeEntry& entry = nodes[i];
+        if (entry.inBatch)
+        {
+            // take off only what was published, readings added while it was sent stay, and the slot is kept for this node
+            for (uint8_t field = 0; field < 4; ++field)
+            {
+                entry.sum[field] -= entry.batchSum[field];
+                entry.count[field] -= entry.batchCount[field];
+            }
+            entry.samples -= entry.batchSamples;
+            entry.inBatch = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
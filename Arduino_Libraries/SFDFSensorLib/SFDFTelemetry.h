@@ -0,0 +1,109 @@
+#ifndef SFDFTELEMETRY_H
+#define SFDFTELEMETRY_H
+
+#include <Arduino.h>
+#include "SFDFFixedPoint.h"
+
+// Command word in front of telemetry frames sent from sensor slaves to the master (eg. "TLM 3 712 850 6200 2315")
+#define TELEMETRY_COMMAND "TLM"
+
+// Max number of nodes the master aggregates readings for
+#define TELEMETRY_MAX_NODES 16
+
+// Longest telemetry frame encodeTelemetry() writes, including null terminator
+#define TELEMETRY_FRAME_LEN 64
+
+/**!
+ * @brief One set of readings from a sensor node
+ */
+struct sensorReading
+{
+    fixedValue ph;
+    fixedValue ec;
+    fixedValue do_data;
+    fixedValue temperature;
+};
+
+/**!
+ * @brief Encodes readings as a text frame "TLM <node> <ph> <ec> <do> <temp>" with raw register values, "-" for invalid readings.
+ * Scales are fixed by sensor type (pH 2, EC 0, DO 3, Temp 2 decimals) so they are not sent.
+ * @param buffer output buffer, should be at least TELEMETRY_FRAME_LEN long
+ * @param size size of output buffer
+ * @param nodeId id of node that took the readings
+ * @param reading readings to encode
+ * @return length of frame, 0 if buffer too small
+ */
+size_t encodeTelemetry(char* buffer, size_t size, uint8_t nodeId, const sensorReading& reading);
+
+/**!
+ * @brief Decodes the part of a telemetry frame after the command word (eg. args passed to an ESP32Now handler)
+ * @param args text after "TLM " (eg. "3 712 850 6200 2315")
+ * @param nodeId set to node id from frame
+ * @param reading set to readings from frame
+ * @return true if frame was well formed
+ */
+bool decodeTelemetry(const char* args, uint8_t& nodeId, sensorReading& reading);
+
+/**!
+ * @brief Collects readings from many nodes on the master and averages them per node until they are published as one batch.
+ * add() can be called from the ESP-Now dispatch task while loop() builds and publishes batches, readings added meanwhile
+ * are kept for the next batch.
+ */
+class telemetryAggregator
+{
+    private:
+        struct nodeEntry
+        {
+            uint8_t nodeId;
+            bool used;
+            bool inBatch;               // written by the last buildBatch(), cleared by commitBatch()
+            uint16_t samples;           // readings added since last batch
+            int64_t sum[4];             // sum of raw values per field, pH, EC, DO, Temp
+            uint16_t count[4];          // number of valid values per field
+            uint8_t decimals[4];
+            uint16_t batchSamples;      // samples, sum and count the last buildBatch() wrote, taken off by commitBatch()
+            int64_t batchSum[4];
+            uint16_t batchCount[4];
+        };
+
+        nodeEntry nodes[TELEMETRY_MAX_NODES] = {};
+        // held only to copy entries in and out, batches are formatted from a copy
+        portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+        /**!
+         * @brief Average of one field of a node as fixed-point
+         */
+        fixedValue average(const nodeEntry& entry, uint8_t field);
+
+    public:
+        /**!
+         * @brief Add one set of readings from a node
+         * @param nodeId id of node, master can use its own id (eg. 0)
+         * @param reading readings to add
+         * @return false if table is full and node is new
+         */
+        bool add(uint8_t nodeId, const sensorReading& reading);
+
+        /**!
+         * @return Number of nodes with readings waiting to be published
+         */
+        size_t pendingNodes();
+
+        /**!
+         * @brief Writes waiting nodes as one JSON message, {"DateTime":"...","nodes":[{"node":1,"pH":7.12,"EC":850,"DO":6.2,"Temp":23.15},...]}.
+         * Written nodes are kept until commitBatch(), so nothing is lost if the publish fails. Call commitBatch() after each
+         * successful publish, then buildBatch() again until it returns 0 to publish everything.
+         * @param buffer output buffer
+         * @param size size of output buffer
+         * @param time time string to put in DateTime, can be empty
+         * @return length of message, 0 if nothing is waiting or buffer can't fit even one node
+         */
+        size_t buildBatch(char* buffer, size_t size, const char* time);
+
+        /**!
+         * @brief Takes the readings written by the last buildBatch() off their nodes, call once that message was published
+         */
+        void commitBatch();
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include <ESP32NowLib.h>
+#include "SFDFSensor.h"
+
+/*
+ Sensor slave example. Reads its own sensors and streams the readings to the master over ESP-Now, the master
+ aggregates readings from every node and publishes them together through its SIM7600 (see sfdf.ino).
+ Uses ESP32NowLib relay mode so readings are tagged with this node's id and can hop through other nodes.
+*/
+
+// Serial 1, pin 18 (U1RX) and 19 (U1TX)
+#define RXD1 18
+#define TXD1 19
+
+// Unique id of this node, master is 0
+#define NODE_ID 1
+
+// ModMaster Nodes, for getting data with modbus
+ModbusMaster node_ec;
+ModbusMaster node_ph;
+ModbusMaster node_do;
+
+sensorNodes nodes(&node_ec,&node_ph,&node_do);
+
+// Create ESP32 node
+ESP32Now espNode(1);
+
+// sample every x milliseconds, on the master's clock so all nodes sample at the same moment, use the same value on every node
+const uint32_t send_interval = 10000;
+
+void setup() {
+  Serial.begin(115200);
+  // Start serial 1
+  Serial1.begin(9600, SERIAL_8N1, RXD1, TXD1);
+  delay(1000);
+
+  // Start sensor modmaster nodes
+  node_ph.begin(1, Serial1);
+  node_ec.begin(2, Serial1);
+  node_do.begin(3, Serial1);
+
+  // Start as slave with relay mode, the master has to call enableRelay(0). The SSID must not start with the name of a pump slave
+  // (eg. "Slave 1"), the master finds those with addPeer() by SSID prefix. Give every sensor slave its own name
+  espNode.ESPNowStartSlave("Sensor 1");
+  espNode.enableRelay(NODE_ID);
+
+  // follow the time beacons the master sends, so sampling lines up with the other nodes
+  espNode.enableTimeSync();
+  espNode.startDispatchTask();
+}
+
+void loop() {
+  // true once per send_interval when the shared grid ticks over, false until the first beacons arrived
+  if (espNode.syncedClock().slotDue(send_interval))
+  {
+    // read all sensors as fixed-point and send as a short text frame (eg. "TLM 1 712 850 6200 2315")
+    sensorReading reading = nodes.readAll();
+    char frame[TELEMETRY_FRAME_LEN];
+    if (encodeTelemetry(frame, sizeof(frame), NODE_ID, reading) > 0)
+    {
+      espNode.relaySend(0, frame);
+    }
+  }
+  delay(1);
+}
\ No newline at end of file
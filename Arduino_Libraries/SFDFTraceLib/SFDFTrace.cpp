@@ -0,0 +1,196 @@
+#include "SFDFTrace.h"
+
+static_assert(TRACE_BUFFER_SIZE % 8 == 0, "dumpSkip keeps a bit per event");
+
+sfdfTrace Trace;
+
+void sfdfTrace::begin(uint32_t loopBudgetMs)
+{
+    loopBudget = loopBudgetMs;
+}
+
+void sfdfTrace::record(const char* name, char phase)
+{
+    uint32_t now = micros();
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL(&lock);
+    if (!paused)
+    {
+        traceEvent& event = events[head % TRACE_BUFFER_SIZE];
+        event.time = now;
+        event.name = name;
+        event.phase = phase;
+        event.task = task;
+        ++head;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void sfdfTrace::loopBegin()
+{
+    loopStart = millis();
+    record("loop", 'B');
+}
+
+uint32_t sfdfTrace::loopEnd()
+{
+    record("loop", 'E');
+    uint32_t elapsed = millis() - loopStart;
+    if (loopBudget == 0 || elapsed <= loopBudget)
+    {
+        return 0;
+    }
+    ++overrunCount;
+    record("loop_overrun", 'i');
+    return elapsed;
+}
+
+uint32_t sfdfTrace::overruns()
+{
+    return overrunCount;
+}
+
+bool sfdfTrace::formatDumpPart(uint32_t index)
+{
+    int length;
+    if (index == 0)
+    {
+        length = snprintf(dumpLine, sizeof(dumpLine), "{\"traceEvents\":[");
+    }
+    else if (index <= dumpCount && (dumpSkip[(index - 1) / 8] & (1 << ((index - 1) % 8))))
+    {
+        length = 0;
+    }
+    else if (index <= dumpCount)
+    {
+        const traceEvent& event = events[(dumpFirst + index - 1) % TRACE_BUFFER_SIZE];
+        length = snprintf(dumpLine, sizeof(dumpLine), "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":0,\"tid\":%lu%s}",
+                          index > dumpFirstKept ? "," : "", event.name, event.phase, (unsigned long)event.time, (unsigned long)(uintptr_t)event.task,
+                          event.phase == 'i' ? ",\"s\":\"g\"" : "");
+    }
+    else if (index == dumpCount + 1)
+    {
+        length = snprintf(dumpLine, sizeof(dumpLine), "]}");
+    }
+    else
+    {
+        return false;
+    }
+
+    // a name too long for the line buffer is cut off, keep the length consistent with what is in the buffer
+    dumpLineLength = min((size_t)max(length, 0), sizeof(dumpLine) - 1);
+    dumpLinePos = 0;
+    return true;
+}
+
+size_t sfdfTrace::beginDump()
+{
+    portENTER_CRITICAL(&lock);
+    paused = true;
+    dumpCount = min(head, (uint32_t)TRACE_BUFFER_SIZE);
+    dumpFirst = head - dumpCount;
+    portEXIT_CRITICAL(&lock);
+
+    // walk the events keeping a scope depth per task, an end event at depth 0 lost its begin event when the ring wrapped
+    struct taskDepth
+    {
+        TaskHandle_t task;
+        uint32_t depth;
+    };
+    taskDepth depths[TRACE_MAX_TASKS];
+    uint8_t taskCount = 0;
+    memset(dumpSkip, 0, sizeof(dumpSkip));
+    dumpFirstKept = 0;
+    for (uint32_t i = 0; i < dumpCount; ++i)
+    {
+        const traceEvent& event = events[(dumpFirst + i) % TRACE_BUFFER_SIZE];
+        if (event.phase == 'B' || event.phase == 'E')
+        {
+            uint8_t t = 0;
+            while (t < taskCount && depths[t].task != event.task)
+            {
+                ++t;
+            }
+            if (t == taskCount && taskCount < TRACE_MAX_TASKS)
+            {
+                depths[taskCount++] = {event.task, 0};
+            }
+            if (t < taskCount)
+            {
+                if (event.phase == 'B')
+                {
+                    depths[t].depth++;
+                }
+                else if (depths[t].depth > 0)
+                {
+                    depths[t].depth--;
+                }
+                else
+                {
+                    dumpSkip[i / 8] |= 1 << (i % 8);
+                    continue;
+                }
+            }
+        }
+        if (dumpFirstKept == 0)
+        {
+            dumpFirstKept = i + 1;
+        }
+    }
+
+    // format everything once to get the exact length the streamed dump will have
+    size_t total = 0;
+    for (uint32_t i = 0; formatDumpPart(i); ++i)
+    {
+        total += dumpLineLength;
+    }
+
+    dumpIndex = 0;
+    formatDumpPart(0);
+    return total;
+}
+
+size_t sfdfTrace::writeDump(char* buffer, size_t size, void* context)
+{
+    sfdfTrace* trace = (sfdfTrace*)context;
+    size_t written = 0;
+    while (written < size)
+    {
+        if (trace->dumpLinePos == trace->dumpLineLength)
+        {
+            if (!trace->formatDumpPart(++trace->dumpIndex))
+            {
+                break;
+            }
+        }
+        size_t length = min(size - written, trace->dumpLineLength - trace->dumpLinePos);
+        memcpy(buffer + written, trace->dumpLine + trace->dumpLinePos, length);
+        trace->dumpLinePos += length;
+        written += length;
+    }
+    return written;
+}
+
+void sfdfTrace::endDump()
+{
+    portENTER_CRITICAL(&lock);
+    paused = false;
+    portEXIT_CRITICAL(&lock);
+}
+
+void sfdfTrace::dump(Print* port)
+{
+    char buffer[TRACE_EVENT_JSON_LEN];
+    size_t length;
+
+    beginDump();
+    port->println("TRACE_BEGIN");
+    while ((length = writeDump(buffer, sizeof(buffer), this)) > 0)
+    {
+        port->write((const uint8_t*)buffer, length);
+    }
+    port->println();
+    port->println("TRACE_END");
+    endDump();
+}
@@ -0,0 +1,146 @@
+/* Lightweight stall profiler, scoped trace points write begin/end events into a fixed-size ring in RAM */
+
+#ifndef SFDFTRACE_H
+#define SFDFTRACE_H
+
+#include <Arduino.h>
+
+// Set to 0 to compile every SFDF_TRACE_SCOPE, in the sketch and in the other SFDF libraries, to nothing
+#ifndef SFDF_TRACE_ENABLED
+#define SFDF_TRACE_ENABLED 1
+#endif
+
+// Number of events kept, oldest are overwritten, each event is 16 bytes
+#define TRACE_BUFFER_SIZE 256
+
+// Longest text one event takes in the Chrome trace JSON
+#define TRACE_EVENT_JSON_LEN 96
+
+// Number of tasks a dump tracks scope nesting for, end events of further tasks are always kept
+#define TRACE_MAX_TASKS 8
+
+/**!
+ * @brief One trace event
+ */
+struct traceEvent
+{
+    uint32_t time;      // micros() when recorded
+    const char* name;   // must be a string literal, only the pointer is kept
+    char phase;         // 'B' begin, 'E' end, 'i' instant (eg. loop overrun)
+    TaskHandle_t task;  // task that recorded it, shown as thread in the timeline
+};
+
+/**!
+ * @brief Ring of trace events plus loop budget check, use the global Trace instance.
+ * Safe to record from any task, dump output is Chrome trace event JSON that chrome://tracing and ui.perfetto.dev open directly.
+ */
+class sfdfTrace
+{
+    private:
+        traceEvent events[TRACE_BUFFER_SIZE];
+        uint32_t head = 0;      // total events recorded, next slot is head % TRACE_BUFFER_SIZE
+        bool paused = false;    // no recording while a dump reads the ring
+        uint32_t loopBudget = 0;
+        uint32_t loopStart = 0;
+        uint32_t overrunCount = 0;
+        portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+        // dump state, see beginDump()
+        uint32_t dumpFirst = 0;
+        uint32_t dumpCount = 0;
+        uint32_t dumpIndex = 0;
+        uint32_t dumpFirstKept = 0;                 // part index of the first event written
+        uint8_t dumpSkip[TRACE_BUFFER_SIZE / 8];    // bit per dumped event, set for end events whose begin was overwritten
+        char dumpLine[TRACE_EVENT_JSON_LEN];
+        size_t dumpLineLength = 0;
+        size_t dumpLinePos = 0;
+
+        /**!
+         * @brief Formats dump part number index (header, event or footer) into dumpLine, a skipped event is an empty part
+         * @return false if past the end
+         */
+        bool formatDumpPart(uint32_t index);
+
+    public:
+        /**!
+         * @brief Set loop time budget, call once in setup()
+         * @param loopBudgetMs loop iterations longer than this are flagged, 0 to turn off
+         */
+        void begin(uint32_t loopBudgetMs);
+
+        /**!
+         * @brief Add an event to the ring
+         * @param name string literal name of trace point
+         * @param phase 'B', 'E' or 'i'
+         */
+        void record(const char* name, char phase);
+
+        /**!
+         * @brief Call at the start of loop()
+         */
+        void loopBegin();
+
+        /**!
+         * @brief Call at the end of loop(), flags the iteration with a "loop_overrun" event if it took longer than the budget
+         * @return time the iteration took in ms if over budget, 0 if within budget
+         */
+        uint32_t loopEnd();
+
+        /**!
+         * @return Number of loop iterations over budget so far
+         */
+        uint32_t overruns();
+
+        /**!
+         * @brief Prints the ring as Chrome trace JSON between TRACE_BEGIN and TRACE_END lines, copy the part in between into a .json file
+         * @param port serial port to print to
+         */
+        void dump(Print* port);
+
+        /**!
+         * @brief Freezes the ring for a streamed dump (eg. over MQTT) and returns its exact length in bytes, call endDump() when done.
+         * Once the ring has wrapped, end events whose begin event was overwritten are left out, so every scope in the dump is whole.
+         */
+        size_t beginDump();
+
+        /**!
+         * @brief Writes the next part of the frozen dump, same signature as the SIM7600AWS streaming writer so it can be
+         * passed as aws.sendDataAWS(topic, Trace.beginDump(), sfdfTrace::writeDump, &Trace)
+         * @param buffer output buffer
+         * @param size max bytes to write
+         * @param context pointer to the sfdfTrace
+         * @return bytes written, 0 at the end
+         */
+        static size_t writeDump(char* buffer, size_t size, void* context);
+
+        /**!
+         * @brief Resumes recording after beginDump()
+         */
+        void endDump();
+};
+
+extern sfdfTrace Trace;
+
+/**!
+ * @brief Records a begin event when created and an end event when it goes out of scope
+ */
+class traceScope
+{
+    private:
+        const char* name;
+    public:
+        traceScope(const char* name): name(name) { Trace.record(name, 'B'); }
+        ~traceScope() { Trace.record(name, 'E'); }
+};
+
+#define SFDF_TRACE_CONCAT_(a, b) a##b
+#define SFDF_TRACE_CONCAT(a, b) SFDF_TRACE_CONCAT_(a, b)
+
+// Trace the rest of the enclosing scope, name must be a string literal
+#if SFDF_TRACE_ENABLED
+#define SFDF_TRACE_SCOPE(name) traceScope SFDF_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define SFDF_TRACE_SCOPE(name)
+#endif
+
+#endif
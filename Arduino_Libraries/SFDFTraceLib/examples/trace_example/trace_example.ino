@@ -0,0 +1,51 @@
+/*
+ Example of the stall profiler. Every few seconds loop() blocks for a while on purpose,
+ the iteration goes over budget and the trace is printed to Serial.
+ Copy the JSON between TRACE_BEGIN and TRACE_END into a .json file and open it in ui.perfetto.dev.
+*/
+
+#include <SFDFTrace.h>
+
+// loop iterations longer than this are flagged, in milliseconds
+const uint32_t loop_budget = 100;
+
+unsigned long previous_slow_millis = 0;
+const long slow_interval = 5000;
+
+void fastWork()
+{
+    SFDF_TRACE_SCOPE("fast_work");
+    delay(5);
+}
+
+void slowWork()
+{
+    SFDF_TRACE_SCOPE("slow_work");
+    delay(300);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    Trace.begin(loop_budget);
+}
+
+void loop()
+{
+    Trace.loopBegin();
+
+    fastWork();
+    if (millis() - previous_slow_millis >= slow_interval)
+    {
+        previous_slow_millis = millis();
+        slowWork();
+    }
+
+    uint32_t loop_time = Trace.loopEnd();
+    if (loop_time > 0)
+    {
+        Serial.print("Loop over budget: "); Serial.print(loop_time); Serial.println(" ms");
+        Serial.print("Overruns so far: "); Serial.println(Trace.overruns());
+        Trace.dump(&Serial);
+    }
+}
@@ -1,109 +1,464 @@
 #include "SIM7600_AWS.h"
+#include <SFDFTrace.h>
+
+/*
+ AT command templates, formatted into a stack buffer by sendCommand() so building a command never allocates.
+ Remember for double quotes " use escape sequence \ like this \"
+*/
+static constexpr char CMD_SSL_VERSION[] = "AT+CSSLCFG=\"sslversion\",0,4";
+static constexpr char CMD_SSL_AUTHMODE[] = "AT+CSSLCFG=\"authmode\",0,2";
+static constexpr char CMD_SSL_CACERT[] = "AT+CSSLCFG=\"cacert\",0,\"%s.pem\"";
+static constexpr char CMD_SSL_CLIENTCERT[] = "AT+CSSLCFG=\"clientcert\",0,\"%s.pem\"";
+static constexpr char CMD_SSL_CLIENTKEY[] = "AT+CSSLCFG=\"clientkey\",0,\"%s.pem\"";
+static constexpr char CMD_NETOPEN[] = "AT+NETOPEN";
+static constexpr char CMD_MQTT_START[] = "AT+CMQTTSTART";
+static constexpr char CMD_MQTT_ACCQ[] = "AT+CMQTTACCQ=0,\"%s\",1";
+static constexpr char CMD_MQTT_SSLCFG[] = "AT+CMQTTSSLCFG=0,0";
+static constexpr char CMD_MQTT_CONNECT[] = "AT+CMQTTCONNECT=0,\"tcp://%s:8883\",60,1";
+static constexpr char CMD_MQTT_SUB[] = "AT+CMQTTSUB=0,%u,1";
+static constexpr char CMD_MQTT_TOPIC[] = "AT+CMQTTTOPIC=0,%u";
+static constexpr char CMD_MQTT_PAYLOAD[] = "AT+CMQTTPAYLOAD=0,%u";
+static constexpr char CMD_MQTT_PUB[] = "AT+CMQTTPUB=0,1,60";
+static constexpr char CMD_MQTT_DISC[] = "AT+CMQTTDISC=0,120";
+static constexpr char CMD_MQTT_REL[] = "AT+CMQTTREL=0";
+static constexpr char CMD_MQTT_STOP[] = "AT+CMQTTSTOP";
+static constexpr char CMD_CLOCK[] = "AT+CCLK?";
+static constexpr char CMD_RESET[] = "AT+CRESET";
+
+// Query commands used by startAWS() to find what the modem already has set up
+static constexpr char QUERY_SSL_CONTEXT[] = "AT+CSSLCFG=0";
+static constexpr char QUERY_NETOPEN[] = "AT+NETOPEN?";
+static constexpr char QUERY_MQTT_CLIENT[] = "AT+CMQTTACCQ?";
+static constexpr char QUERY_MQTT_CONNECTION[] = "AT+CMQTTDISC?";
+
+// Timeouts for replies, in milliseconds
+#define SIM7600_TIMEOUT_SHORT 2000
+#define SIM7600_TIMEOUT_NETOPEN 15000
+#define SIM7600_TIMEOUT_CONNECT 30000
+#define SIM7600_TIMEOUT_PUBLISH 10000
+
+// Longest fixed part of a template plus the longest argument has to fit the command buffer
+static_assert(sizeof(CMD_MQTT_CONNECT) + 100 <= SIM7600_CMD_BUFFER_SIZE, "SIM7600_CMD_BUFFER_SIZE too small for endpoint url");
+
+// URCs the modem sends for a received MQTT message, in this order, RXTOPIC and RXPAYLOAD are followed by that many raw bytes
+static constexpr char URC_RX_START[] = "+CMQTTRXSTART: ";
+static constexpr char URC_RX_TOPIC[] = "+CMQTTRXTOPIC: ";
+static constexpr char URC_RX_PAYLOAD[] = "+CMQTTRXPAYLOAD: ";
+static constexpr char URC_RX_END[] = "+CMQTTRXEND: ";
+
+/**!
+ * @brief Holds the modem port mutex until the end of the scope
+ */
+class modemLock
+{
+    private:
+        SIM7600AWS* aws;
+    public:
+        modemLock(SIM7600AWS* aws): aws(aws) { aws->lockModem(); }
+        ~modemLock() { aws->unlockModem(); }
+};
+
+SIM7600AWS::SIM7600AWS(Stream *simPort, Stream *printPort): sim7600Port(simPort), printSerialPort(printPort)
+{
+    portMutex = xSemaphoreCreateRecursiveMutex();
+};
+
+void SIM7600AWS::sendCommand(const char* format, ...)
+{
+    char command[SIM7600_CMD_BUFFER_SIZE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(command, sizeof(command), format, args);
+    va_end(args);
+
+    if (length < 0 || length >= (int)sizeof(command))
+    {
+        printSerialPort->println("AT command too long, not sent");
+        return;
+    }
+    sendLine(command, length);
+}
+
+void SIM7600AWS::sendLine(const char* data, size_t length)
+{
+    sim7600Port->write((const uint8_t*)data, length);
+    sim7600Port->write((const uint8_t*)"\r\n", 2);
+}
+
+size_t SIM7600AWS::readResponse(char* buffer, size_t size, unsigned long timeout)
+{
+    SFDF_TRACE_SCOPE("sim_read_response");
+    size_t length = 0;
+    unsigned long last_byte_millis = millis();
+
+    // keep reading until nothing new arrives for timeout ms, like readString() does
+    while (millis() - last_byte_millis < timeout)
+    {
+        if (sim7600Port->available())
+        {
+            int c = sim7600Port->read();
+            if (c >= 0)
+            {
+                parseDownlink((char)c);
+            }
+            // drop anything that doesn't fit but keep draining the port
+            if (c >= 0 && length + 1 < size)
+            {
+                buffer[length++] = (char)c;
+            }
+            last_byte_millis = millis();
+        }
+        else
+        {
+            yield();
+        }
+    }
+    if (size > 0)
+    {
+        buffer[length] = 0;
+    }
+    return length;
+}
+
+SIM7600AWS::modemReply SIM7600AWS::waitReply(const char* expected, const char* finalLine, unsigned long timeout, char* response)
+{
+    SFDF_TRACE_SCOPE("sim_wait_response");
+    char local[SIM7600_RESPONSE_BUFFER_SIZE];
+    char* buffer = response != nullptr ? response : local;
+    size_t length = 0;
+    size_t lineStart = 0;
+    size_t finalLength = finalLine != nullptr ? strlen(finalLine) : 0;
+    buffer[0] = 0;
+
+    unsigned long start_millis = millis();
+    while (millis() - start_millis < timeout)
+    {
+        if (!sim7600Port->available())
+        {
+            yield();
+            continue;
+        }
+
+        // buffer full, drop the older half so the end of the reply is still matched
+        if (length + 1 >= SIM7600_RESPONSE_BUFFER_SIZE)
+        {
+            size_t half = SIM7600_RESPONSE_BUFFER_SIZE / 2;
+            memmove(buffer, buffer + half, length - half);
+            length -= half;
+            lineStart = lineStart > half ? lineStart - half : 0;
+        }
+        char c = (char)sim7600Port->read();
+        if (parseDownlink(c))
+        {
+            // a message from AWS arriving in the middle of the reply, its payload may contain anything (eg. "OK")
+            continue;
+        }
+        buffer[length++] = c;
+        buffer[length] = 0;
+
+        if (strstr(buffer, expected) != NULL)
+        {
+            return REPLY_EXPECTED;
+        }
+        if (strstr(buffer, "ERROR") != NULL)
+        {
+            return REPLY_ERROR;
+        }
+        if (c == '\n')
+        {
+            // only whole lines are checked for finalLine, so "+CMQTTPUB: 0," can't match before its result code arrived
+            if (finalLength > 0 && strncmp(buffer + lineStart, finalLine, finalLength) == 0)
+            {
+                return REPLY_FINAL;
+            }
+            lineStart = length;
+        }
+    }
+    return REPLY_TIMEOUT;
+}
+
+bool SIM7600AWS::waitResponse(const char* expected, unsigned long timeout, char* response)
+{
+    return waitReply(expected, nullptr, timeout, response) == REPLY_EXPECTED;
+}
+
+bool SIM7600AWS::isSSLConfigured(const char* cacert, const char* clientcert, const char* clientkey)
+{
+    // reply lists the context settings, eg. +CSSLCFG: 0,4,2,...,"cacert.pem","clientcert.pem","clientkey.pem",...
+    char response[SIM7600_RESPONSE_BUFFER_SIZE];
+    sendCommand(QUERY_SSL_CONTEXT);
+    if (!waitResponse("OK", SIM7600_TIMEOUT_SHORT, response))
+    {
+        return false;
+    }
+
+    const char* files[3] = {cacert, clientcert, clientkey};
+    char quoted[64];
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        snprintf(quoted, sizeof(quoted), "\"%s.pem\"", files[i]);
+        if (strstr(response, quoted) == NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SIM7600AWS::isConnectedAWS()
+{
+    modemLock lock(this);
+    // +CMQTTDISC: <client>,<state> for every client, state 0 means connected, read up to the final OK so no line is left over
+    char response[SIM7600_RESPONSE_BUFFER_SIZE];
+    sendCommand(QUERY_MQTT_CONNECTION);
+    return waitResponse("OK", SIM7600_TIMEOUT_SHORT, response) && strstr(response, "+CMQTTDISC: 0,0") != NULL;
+}
+
+bool SIM7600AWS::startAWS(const char* clientName, const char* awsEndpoint, const char* cacert, const char* clientcert, const char* clientkey)
+{
+    SFDF_TRACE_SCOPE("sim_start_aws");
+    modemLock lock(this);
+    // modem kept its MQTT connection (eg. only the ESP32 browned out), nothing to do
+    if (isConnectedAWS())
+    {
+        printSerialPort->println("AWS still connected, skipping setup");
+        return true;
+    }
+
+    if (!isSSLConfigured(cacert, clientcert, clientkey))
+    {
+        printSerialPort->println("Configuring SSL");
+        sendCommand(CMD_SSL_VERSION);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+        sendCommand(CMD_SSL_AUTHMODE);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+        sendCommand(CMD_SSL_CACERT, cacert);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+        sendCommand(CMD_SSL_CLIENTCERT, clientcert);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+        sendCommand(CMD_SSL_CLIENTKEY, clientkey);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+    }
+
+    // +NETOPEN: 1 means network already open
+    char response[SIM7600_RESPONSE_BUFFER_SIZE];
+    sendCommand(QUERY_NETOPEN);
+    if (!waitResponse("OK", SIM7600_TIMEOUT_SHORT, response) || strstr(response, "+NETOPEN: 1") == NULL)
+    {
+        printSerialPort->println("Opening network");
+        sendCommand(CMD_NETOPEN);
+        // +NETOPEN: 0 when opened, any other +NETOPEN result code is a failure
+        waitReply("+NETOPEN: 0", "+NETOPEN:", SIM7600_TIMEOUT_NETOPEN);
+    }
+
+    // query fails with ERROR if MQTT service isn't started, client name is empty if no client acquired
+    sendCommand(QUERY_MQTT_CLIENT);
+    bool serviceStarted = waitResponse("OK", SIM7600_TIMEOUT_SHORT, response);
+    if (!serviceStarted)
+    {
+        printSerialPort->println("Starting MQTT service");
+        sendCommand(CMD_MQTT_START);
+        waitReply("+CMQTTSTART: 0", "+CMQTTSTART:", SIM7600_TIMEOUT_SHORT);
+    }
+
+    char quotedClient[64];
+    snprintf(quotedClient, sizeof(quotedClient), "+CMQTTACCQ: 0,\"%s\"", clientName);
+    if (!serviceStarted || strstr(response, quotedClient) == NULL)
+    {
+        printSerialPort->println("Acquiring MQTT client");
+        if (strstr(response, "+CMQTTACCQ: 0,\"\"") == NULL && serviceStarted)
+        {
+            // a client with another name holds index 0, release it first
+            sendCommand(CMD_MQTT_REL);
+            waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+        }
+        sendCommand(CMD_MQTT_ACCQ, clientName);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+    }
 
-SIM7600AWS::SIM7600AWS(Stream *simPort, Stream *printPort): sim7600Port(simPort), printSerialPort(printPort){};
+    // Set the first SSL context to be used in the SSL connection, cheap so always done
+    sendCommand(CMD_MQTT_SSLCFG);
+    waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+
+    printSerialPort->println("Connecting to AWS");
+    sendCommand(CMD_MQTT_CONNECT, awsEndpoint);
+    bool connected = waitReply("+CMQTTCONNECT: 0,0", "+CMQTTCONNECT: 0,", SIM7600_TIMEOUT_CONNECT) == REPLY_EXPECTED;
+    printSerialPort->println(connected ? "Connected to AWS" : "Failed to connect to AWS");
+    return connected;
+}
 
-void SIM7600AWS::testSim(String command)
+void SIM7600AWS::testSim(const char* command)
 {
-    sim7600Port->println(command);
+    modemLock lock(this);
+    sendCommand("%s", command);
     printSerial();
     delay(50);
 }
 
-void SIM7600AWS::configureSSL(String cacert, String clientcert, String clientkey)
+void SIM7600AWS::configureSSL(const char* cacert, const char* clientcert, const char* clientkey)
 {
-    // remember for double quotes " use escape sequence \ when sending string like this \"
-
+    modemLock lock(this);
     // Set the SSL version of the first SSL context
-    sim7600Port->println("AT+CSSLCFG=\"sslversion\",0,4");
+    sendCommand(CMD_SSL_VERSION);
     delay(100);
 
     // Set the authentication mode to verify server and client
-    sim7600Port->println("AT+CSSLCFG=\"authmode\",0,2");
+    sendCommand(CMD_SSL_AUTHMODE);
     delay(100);
     // Set the server root CA of the first SSL contex
-    sim7600Port->println("AT+CSSLCFG=\"cacert\",0,\""+ cacert +".pem\"");
+    sendCommand(CMD_SSL_CACERT, cacert);
     delay(100);
 
     // Set the client certificate of the first SSL context
-    sim7600Port->println("AT+CSSLCFG=\"clientcert\",0,\""+ clientcert +".pem\"");
+    sendCommand(CMD_SSL_CLIENTCERT, clientcert);
     delay(100);
 
     // Set the client key of the first SSL context
-    sim7600Port->println("AT+CSSLCFG=\"clientkey\",0,\"" + clientkey + ".pem\"");
+    sendCommand(CMD_SSL_CLIENTKEY, clientkey);
     delay(100);
-    
+
     // open network
-    sim7600Port->println("AT+NETOPEN");
+    sendCommand(CMD_NETOPEN);
 
 }
 
-void SIM7600AWS::connectAWS(String clientName, String awsEndpoint)
+void SIM7600AWS::connectAWS(const char* clientName, const char* awsEndpoint)
 {
+    modemLock lock(this);
     // start MQTT service
-    sim7600Port->println("AT+CMQTTSTART");
+    sendCommand(CMD_MQTT_START);
     printSerial();
     delay(4000);
 
     // Acquire one client which will connect to a SSL/TLS MQTT server
-    sim7600Port->println("AT+CMQTTACCQ=0,\""+ clientName + "\",1");
+    sendCommand(CMD_MQTT_ACCQ, clientName);
     printSerial();
     delay(4000);
 
     // Set the first SSL context to be used in the SSL connection
-    sim7600Port->println("AT+CMQTTSSLCFG=0,0");
+    sendCommand(CMD_MQTT_SSLCFG);
     printSerial();
     delay(4000);
 
-    // Connect to a MQTT server, in this case aws
-    // printSerialPort->println("AT+CMQTT Connect");
-    // Serial2.println("AT+CMQTTCONNECT=0,\"tcp://a5sswhj5ru4gy-ats.iot.us-east-2.amazonaws.com:8883\",60,1");
-    sim7600Port->println("AT+CMQTTCONNECT=0,\"tcp://"+ awsEndpoint + ":8883\",60,1");
+    // Connect to a MQTT server, in this case aws (eg. tcp://a5sswhj5ru4gy-ats.iot.us-east-2.amazonaws.com:8883)
+    sendCommand(CMD_MQTT_CONNECT, awsEndpoint);
     printSerial();
     delay(5000);
 }
 
-void SIM7600AWS::subscribeTopic(String topic)
+void SIM7600AWS::subscribeTopic(const char* topic)
 {
+    modemLock lock(this);
     // subscribe to topic
-    sim7600Port->println("AT+CMQTTSUB=0,"+String(topic.length())+",1");
+    size_t length = strlen(topic);
+    sendCommand(CMD_MQTT_SUB, (unsigned)length);
     delay(50);
-    sim7600Port->println(topic);
+    sendLine(topic, length);
     delay(100);
     printSerial();
 }
 
-void SIM7600AWS::sendDataAWS(String topic, String message)
+bool SIM7600AWS::sendDataAWS(const char* topic, const char* message)
 {
-      // Set the topic for the PUBLISH message
-    // printSerialPort->println("AT+CMQTTTOPIC=0,"+String(topic.length()));
-    sim7600Port->println("AT+CMQTTTOPIC=0,"+String(topic.length()));
-    delay(20);
-    sim7600Port->println(topic); // inputs topic name
-    printSerial();
-    delay(300);
+    return sendDataAWS(topic, message, strlen(message));
+}
 
-    // Set the payload for the PUBLISH message
-    sim7600Port->println("AT+CMQTTPAYLOAD=0," + String(message.length())); 
-    delay(20);
-    sim7600Port->println(message); // input message to be sent
-    printSerial();
-    delay(300);
+// Position in an in-memory message being streamed by sendDataAWS()
+struct memoryPayload
+{
+    const char* data;
+    size_t remaining;
+};
+
+static size_t writeFromMemory(char* buffer, size_t size, void* context)
+{
+    memoryPayload* payload = (memoryPayload*)context;
+    size_t length = min(size, payload->remaining);
+    memcpy(buffer, payload->data, length);
+    payload->data += length;
+    payload->remaining -= length;
+    return length;
+}
+
+bool SIM7600AWS::sendDataAWS(const char* topic, const char* message, size_t length)
+{
+    memoryPayload payload = {message, length};
+    return sendDataAWS(topic, length, writeFromMemory, &payload);
+}
+
+bool SIM7600AWS::sendDataAWS(const char* topic, size_t length, payloadWriter writer, void* context)
+{
+    SFDF_TRACE_SCOPE("sim_publish");
+    modemLock lock(this);
+    size_t topic_length = strlen(topic);
+
+    // a message bigger than the modem takes at once goes out as several publishes, each on <topic>/part/<i>/<n>
+    unsigned parts = length > SIM7600_MAX_PAYLOAD ? (length + SIM7600_MAX_PAYLOAD - 1) / SIM7600_MAX_PAYLOAD : 1;
+    char suffix[24] = "";
+    size_t suffix_length = 0;
+    for (unsigned part = 1; part <= parts; ++part)
+    {
+        size_t part_length = min(length, (size_t)SIM7600_MAX_PAYLOAD);
+        length -= part_length;
+        if (parts > 1)
+        {
+            suffix_length = snprintf(suffix, sizeof(suffix), "/part/%u/%u", part, parts);
+        }
+
+        // Set the topic for the PUBLISH message, modem prompts with > then takes exactly topic_length bytes
+        sendCommand(CMD_MQTT_TOPIC, (unsigned)(topic_length + suffix_length));
+        if (!waitResponse(">", SIM7600_TIMEOUT_SHORT))
+        {
+            return false;
+        }
+        sim7600Port->write((const uint8_t*)topic, topic_length);
+        sim7600Port->write((const uint8_t*)suffix, suffix_length);
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+
+        // Set the payload, streamed through a small buffer so it never has to be in RAM all at once
+        sendCommand(CMD_MQTT_PAYLOAD, (unsigned)part_length);
+        if (!waitResponse(">", SIM7600_TIMEOUT_SHORT))
+        {
+            return false;
+        }
+        char chunk[SIM7600_CHUNK_SIZE];
+        size_t sent = 0;
+        bool complete = true;
+        while (sent < part_length)
+        {
+            size_t written = complete ? writer(chunk, min(sizeof(chunk), part_length - sent), context) : 0;
+            if (written == 0)
+            {
+                // writer ran out early, modem still waits for the promised length so pad it out
+                memset(chunk, ' ', sizeof(chunk));
+                written = min(sizeof(chunk), part_length - sent);
+                complete = false;
+            }
+            sim7600Port->write((const uint8_t*)chunk, written);
+            sent += written;
+        }
+        waitResponse("OK", SIM7600_TIMEOUT_SHORT);
+        if (!complete)
+        {
+            // padded payload stays in the modem unpublished, the next CMQTTPAYLOAD replaces it
+            printSerialPort->println("Payload shorter than announced, not published");
+            return false;
+        }
 
-    // Publish message
-    sim7600Port->println("AT+CMQTTPUB=0,1,60");
-    printSerial();  
+        // Publish message, any other result code is a failed publish, don't wait out the timeout for it
+        sendCommand(CMD_MQTT_PUB);
+        if (waitReply("+CMQTTPUB: 0,0", "+CMQTTPUB: 0,", SIM7600_TIMEOUT_PUBLISH) != REPLY_EXPECTED)
+        {
+            // later parts are useless to the receiver without this one
+            return false;
+        }
+    }
+    return true;
 }
 
-void SIM7600AWS::sendSensorData(String topic, double ph, double ec, double do_data, double temperature)
+void SIM7600AWS::sendSensorData(const char* topic, double ph, double ec, double do_data, double temperature)
 {
     is_sending_aws = 1;
-    // Set the topic for the PUBLISH message
-    printSerialPort->println("AT+CMQTTTOPIC=0,"+String(topic.length()));
-    sim7600Port->println("AT+CMQTTTOPIC=0,"+String(topic.length()));
-    delay(20);
-    sim7600Port->println(topic); // inputs topic name
-    printSerial();
-    delay(300);
 
     // create json document
     StaticJsonDocument<200> doc;
@@ -112,67 +467,301 @@ void SIM7600AWS::sendSensorData(String topic, double ph, double ec, double do_da
     JsonObject data = doc.createNestedObject("data");
 
     // add sensor data to object data
+    char time[SIM7600_TIME_STR_LEN];
+    getTime(time, sizeof(time));
     data["pH"] = ph;
-    delay(50);
     data["EC"] = ec;
-    delay(50);
     data["DO"] = do_data;
-    delay(50);
     data["Temp"] = temperature;
-    delay(50);
-    data["DateTime"] = getTime();
-    
-    // convert json to string
-    String message;
-    serializeJson(doc, message);
-    printSerialPort->println("\n"+message);
-
-    // is_sending_aws = 1;
-    // Set the payload for the PUBLISH message
-    sim7600Port->println("AT+CMQTTPAYLOAD=0," + String(message.length())); 
-    delay(20);
-    sim7600Port->println(message); // input json message to be sent
-    // is_sending_aws = 0;
-    printSerial();
-    delay(300);
+    data["DateTime"] = (const char*)time;
+
+    // convert json to string in a stack buffer
+    char message[SIM7600_MSG_BUFFER_SIZE];
+    size_t length = serializeJson(doc, message, sizeof(message));
+    printSerialPort->println();
+    printSerialPort->println(message);
 
-    // Publish message
-    sim7600Port->println("AT+CMQTTPUB=0,1,60");
-    printSerial();  
+    sendDataAWS(topic, message, length);
     is_sending_aws = 0;
 }
 
+void SIM7600AWS::sendSensorData(const char* topic, fixedValue ph, fixedValue ec, fixedValue do_data, fixedValue temperature)
+{
+    is_sending_aws = 1;
+
+    // format each value as text with integer math, then insert as raw JSON so ArduinoJson doesn't convert to double
+    char phStr[FIXED_VALUE_STR_LEN];
+    char ecStr[FIXED_VALUE_STR_LEN];
+    char doStr[FIXED_VALUE_STR_LEN];
+    char tempStr[FIXED_VALUE_STR_LEN];
+    formatFixed(phStr, sizeof(phStr), ph);
+    formatFixed(ecStr, sizeof(ecStr), ec);
+    formatFixed(doStr, sizeof(doStr), do_data);
+    formatFixed(tempStr, sizeof(tempStr), temperature);
+
+    char time[SIM7600_TIME_STR_LEN];
+    getTime(time, sizeof(time));
+
+    // create json document with same layout as double version
+    StaticJsonDocument<200> doc;
+    JsonObject data = doc.createNestedObject("data");
+    data["pH"] = serialized((const char*)phStr);
+    data["EC"] = serialized((const char*)ecStr);
+    data["DO"] = serialized((const char*)doStr);
+    data["Temp"] = serialized((const char*)tempStr);
+    data["DateTime"] = (const char*)time;
+
+    char message[SIM7600_MSG_BUFFER_SIZE];
+    size_t length = serializeJson(doc, message, sizeof(message));
+    printSerialPort->println();
+    printSerialPort->println(message);
+
+    sendDataAWS(topic, message, length);
+    is_sending_aws = 0;
+}
+
+int SIM7600AWS::sendTelemetryBatch(const char* topic, telemetryAggregator& aggregator)
+{
+    if (aggregator.pendingNodes() == 0)
+    {
+        return 0;
+    }
+
+    is_sending_aws = 1;
+    char time[SIM7600_TIME_STR_LEN];
+    getTime(time, sizeof(time));
+
+    // static so a large batch doesn't have to fit on the loop task stack
+    static char message[SIM7600_BATCH_BUFFER_SIZE];
+    int published = 0;
+    size_t length;
+    while ((length = aggregator.buildBatch(message, sizeof(message), time)) > 0)
+    {
+        // let alarms and command acks go ahead of each batch message
+        sendUrgent();
+        printSerialPort->println(message);
+        if (!sendDataAWS(topic, message, length))
+        {
+            // readings stay in the aggregator and go out with the next call
+            printSerialPort->println("Telemetry batch not published, kept for next time");
+            break;
+        }
+        aggregator.commitBatch();
+        ++published;
+    }
+    is_sending_aws = 0;
+    return published;
+}
+
+bool SIM7600AWS::queueDataAWS(const char* topic, const char* message, uplinkPriority priority)
+{
+    size_t topic_length = strlen(topic);
+    size_t length = strlen(message);
+    if (priority >= UPLINK_LANES || topic_length >= SIM7600_UPLINK_TOPIC_LEN || length >= SIM7600_UPLINK_MSG_LEN)
+    {
+        return false;
+    }
+
+    // reserve the slot past the last one, other tasks can queue behind it while this one copies
+    uplinkLane& lane = lanes[priority];
+    uplinkMessage* entry = nullptr;
+    unsigned long now = millis();
+    portENTER_CRITICAL(&uplinkLock);
+    if (lane.count < SIM7600_UPLINK_QUEUE_SIZE)
+    {
+        entry = &lane.messages[(lane.head + lane.count) % SIM7600_UPLINK_QUEUE_SIZE];
+        entry->queuedAt = now;
+        lane.count++;
+    }
+    portEXIT_CRITICAL(&uplinkLock);
+    if (entry == nullptr)
+    {
+        return false;
+    }
+
+    // nobody else touches a reserved slot, the sender waits for ready
+    memcpy(entry->topic, topic, topic_length + 1);
+    memcpy(entry->message, message, length + 1);
+    entry->length = length;
+
+    portENTER_CRITICAL(&uplinkLock);
+    entry->ready = true;
+    portEXIT_CRITICAL(&uplinkLock);
+    return true;
+}
+
+bool SIM7600AWS::laneReady(int lane)
+{
+    return lanes[lane].count > 0 && lanes[lane].messages[lanes[lane].head].ready;
+}
+
+int SIM7600AWS::nextUplinkLane(bool includeBulk)
+{
+    int lane = -1;
+    portENTER_CRITICAL(&uplinkLock);
+    if (includeBulk && laneReady(UPLINK_BULK) && bulkWaits >= SIM7600_BULK_STARVATION_LIMIT)
+    {
+        lane = UPLINK_BULK;
+    }
+    else
+    {
+        int last = includeBulk ? UPLINK_BULK : UPLINK_COMMAND_ACK;
+        for (int i = UPLINK_ALARM; i <= last; ++i)
+        {
+            if (laneReady(i))
+            {
+                lane = i;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&uplinkLock);
+    return lane;
+}
+
+bool SIM7600AWS::sendQueued(int lane)
+{
+    // only this side moves head, so the message stays put while it is sent
+    uplinkLane& queue = lanes[lane];
+    uplinkMessage& entry = queue.messages[queue.head];
+    if (!sendDataAWS(entry.topic, entry.message, entry.length))
+    {
+        return false;
+    }
+    unsigned long latency = millis() - entry.queuedAt;
+
+    portENTER_CRITICAL(&uplinkLock);
+    entry.ready = false;
+    queue.head = (queue.head + 1) % SIM7600_UPLINK_QUEUE_SIZE;
+    queue.count--;
+    if (latency > queue.maxLatency)
+    {
+        queue.maxLatency = latency;
+    }
+    if (lane == UPLINK_BULK)
+    {
+        bulkWaits = 0;
+    }
+    else if (lanes[UPLINK_BULK].count > 0)
+    {
+        bulkWaits++;
+    }
+    portEXIT_CRITICAL(&uplinkLock);
+    return true;
+}
+
+int SIM7600AWS::processUplink()
+{
+    if (uplinkBusy)
+    {
+        return 0;
+    }
+    uplinkBusy = true;
+
+    int sent = 0;
+    int lane;
+    while ((lane = nextUplinkLane(true)) >= 0 && sendQueued(lane))
+    {
+        ++sent;
+    }
+
+    uplinkBusy = false;
+    return sent;
+}
+
+int SIM7600AWS::sendUrgent()
+{
+    if (uplinkBusy)
+    {
+        return 0;
+    }
+    uplinkBusy = true;
+
+    // the batch being flushed counts as bulk, so give it its turn back after the starvation limit
+    int sent = 0;
+    int lane;
+    while (sent < SIM7600_BULK_STARVATION_LIMIT && (lane = nextUplinkLane(false)) >= 0 && sendQueued(lane))
+    {
+        ++sent;
+    }
+
+    uplinkBusy = false;
+    return sent;
+}
+
+size_t SIM7600AWS::pendingUplink(uplinkPriority priority)
+{
+    return priority < UPLINK_LANES ? lanes[priority].count : 0;
+}
+
+unsigned long SIM7600AWS::maxUplinkLatency(uplinkPriority priority)
+{
+    return priority < UPLINK_LANES ? lanes[priority].maxLatency : 0;
+}
+
 String SIM7600AWS::getTime()
 {
+    char time[SIM7600_TIME_STR_LEN];
+    getTime(time, sizeof(time));
+    return String(time);
+}
+
+bool SIM7600AWS::getTime(char* buffer, size_t size)
+{
+    SFDF_TRACE_SCOPE("sim_get_time");
+    modemLock lock(this);
     // Get real time clock management of SIM module, full format is “yy/MM/dd,hh:mm:ss±zz”, eg.(+CCLK: “08/11/28,12:30:35+32”)
-    sim7600Port->println("AT+CCLK?");
-    String temp = getResponse();
-    // Cconcatenate response to format of: YY/MM/DD, HH:MM:SS (eg. 23/04/14,12:42:16)
-    String time = temp.substring(19,36);
-    printSerialPort->println(time);
-    return time;
+    sendCommand(CMD_CLOCK);
+    // wait for the OK that ends the reply instead of a second of silence
+    char response[SIM7600_RESPONSE_BUFFER_SIZE];
+    waitResponse("OK", SIM7600_TIMEOUT_SHORT, response);
+
+    // copy out the part in format of: YY/MM/DD,HH:MM:SS (eg. 23/04/14,12:42:16)
+    const char* start = strstr(response, "+CCLK: \"");
+    if (start == NULL || size < SIM7600_TIME_STR_LEN || strlen(start) < 8 + SIM7600_TIME_STR_LEN - 1)
+    {
+        if (size > 0)
+        {
+            buffer[0] = 0;
+        }
+        return false;
+    }
+    memcpy(buffer, start + 8, SIM7600_TIME_STR_LEN - 1);
+    buffer[SIM7600_TIME_STR_LEN - 1] = 0;
+    printSerialPort->println(buffer);
+    return true;
 }
 
 void SIM7600AWS::printSerial()
 {
-    while (sim7600Port->available()) 
+    modemLock lock(this);
+    // copy bytes straight across instead of readString() so nothing is allocated
+    char buffer[64];
+    while (sim7600Port->available())
     {
-        printSerialPort->println(sim7600Port->readString());
+        size_t length = sim7600Port->readBytes(buffer, min((size_t)sim7600Port->available(), sizeof(buffer)));
+        for (size_t i = 0; i < length; ++i)
+        {
+            parseDownlink(buffer[i]);
+        }
+        printSerialPort->write((const uint8_t*)buffer, length);
     }
 }
 
 String SIM7600AWS::readSerial()
 {
+    modemLock lock(this);
     String response;
     while(sim7600Port->available())
     {
         response = sim7600Port->readString();
-    }    
+    }
     return response;
 }
 
 String SIM7600AWS::getResponse()
 {
+    modemLock lock(this);
     String response;
 
     response = sim7600Port->readString();
@@ -183,54 +772,184 @@ String SIM7600AWS::getResponse()
 
 void SIM7600AWS::resetModule()
 {
-    sim7600Port->println("AT+CRESET");
+    modemLock lock(this);
+    sendCommand(CMD_RESET);
     printSerial();
-    delay(35000);          
+    delay(35000);
 }
 
 void SIM7600AWS::disconnectAWS()
 {
+    modemLock lock(this);
     // disconnect from server
-  sim7600Port->println("AT+CMQTTDISC=0,120");
+  sendCommand(CMD_MQTT_DISC);
   printSerial();
   delay(50);
 
   // release client
-  sim7600Port->println("AT+CMQTTREL=0");
+  sendCommand(CMD_MQTT_REL);
   printSerial();
   delay(50);
 
   // stop mqtt service
-  sim7600Port->println("AT+CMQTTSTOP");
+  sendCommand(CMD_MQTT_STOP);
   printSerial();
   delay(50);
 }
 
-void SIM7600AWS::checkResponseAWS(String check, String command1, String command2, String slaveName, void (&func)(String,String))
+void SIM7600AWS::setDownlinkHandler(mqttMessageHandler handler)
+{
+    downlinkHandler = handler;
+}
+
+unsigned long SIM7600AWS::downlinkReceivedAt()
 {
+    return rxStartMicros;
+}
+
+void SIM7600AWS::lockModem()
+{
+    xSemaphoreTakeRecursive(portMutex, portMAX_DELAY);
+    ++lockDepth;
+}
+
+void SIM7600AWS::unlockModem()
+{
+    if (--lockDepth > 0)
+    {
+        xSemaphoreGiveRecursive(portMutex);
+        return;
+    }
+    xSemaphoreGiveRecursive(portMutex);
+
+    // bytes that arrived after the last reply was read would wait for the next UART event otherwise, which may never come.
+    // checked after giving the mutex back, processDownlink() sets the flag before trying it, so one of the two reads them
+    while (downlinkPending && xSemaphoreTakeRecursive(portMutex, 0) == pdTRUE)
+    {
+        ++lockDepth;
+        drainDownlink();
+        --lockDepth;
+        xSemaphoreGiveRecursive(portMutex);
+    }
+}
+
+void SIM7600AWS::drainDownlink()
+{
+    SFDF_TRACE_SCOPE("sim_downlink");
+    downlinkPending = false;
+    int c;
+    while (sim7600Port->available() > 0 && (c = sim7600Port->read()) >= 0)
+    {
+        parseDownlink((char)c);
+    }
+}
+
+int SIM7600AWS::processDownlink()
+{
+    // a publish or query in progress reads the port itself and feeds the parser, don't fight it for the bytes but leave a
+    // note so it reads whatever is left once it is done
+    downlinkPending = true;
+    if (xSemaphoreTakeRecursive(portMutex, 0) != pdTRUE)
+    {
+        return 0;
+    }
+    ++lockDepth;
+
+    uint32_t before = downlinkMessages;
+    drainDownlink();
+
+    unlockModem();
+    return downlinkMessages - before;
+}
+
+bool SIM7600AWS::parseDownlink(char c)
+{
+    if (downlinkState == URC_TOPIC || downlinkState == URC_PAYLOAD)
+    {
+        // raw topic/payload bytes, may contain anything so they are counted and not parsed
+        if (downlinkState == URC_TOPIC && rxTopicLength + 1 < sizeof(rxTopic))
+        {
+            rxTopic[rxTopicLength++] = c;
+        }
+        else if (downlinkState == URC_PAYLOAD && rxPayloadLength + 1 < sizeof(rxPayload))
+        {
+            rxPayload[rxPayloadLength++] = c;
+        }
+        if (--rxRemaining == 0)
+        {
+            downlinkState = URC_LINE;
+        }
+        return true;
+    }
+
+    if (c == '\n')
+    {
+        urcLine[urcLineLength] = 0;
+        handleUrcLine();
+        urcLineLength = 0;
+    }
+    else if (c != '\r' && urcLineLength + 1 < sizeof(urcLine))
+    {
+        urcLine[urcLineLength++] = c;
+    }
+    return false;
+}
+
+void SIM7600AWS::handleUrcLine()
+{
+    if (strncmp(urcLine, URC_RX_START, sizeof(URC_RX_START) - 1) == 0)
+    {
+        rxStartMicros = micros();
+        rxTopicLength = 0;
+        rxPayloadLength = 0;
+    }
+    else if (strncmp(urcLine, URC_RX_TOPIC, sizeof(URC_RX_TOPIC) - 1) == 0 || strncmp(urcLine, URC_RX_PAYLOAD, sizeof(URC_RX_PAYLOAD) - 1) == 0)
+    {
+        // +CMQTTRXTOPIC: <client>,<length>, the bytes follow on the next line
+        const char* comma = strchr(urcLine, ',');
+        rxRemaining = comma != NULL ? strtoul(comma + 1, NULL, 10) : 0;
+        if (rxRemaining > 0)
+        {
+            downlinkState = strncmp(urcLine, URC_RX_TOPIC, sizeof(URC_RX_TOPIC) - 1) == 0 ? URC_TOPIC : URC_PAYLOAD;
+        }
+    }
+    else if (strncmp(urcLine, URC_RX_END, sizeof(URC_RX_END) - 1) == 0)
+    {
+        rxTopic[rxTopicLength] = 0;
+        rxPayload[rxPayloadLength] = 0;
+        downlinkMessages++;
+        if (downlinkHandler != nullptr)
+        {
+            downlinkHandler(rxTopic, rxPayload);
+        }
+    }
+}
+
+void SIM7600AWS::checkResponseAWS(const char* check, const char* command1, const char* command2, const char* slaveName, void (&func)(const char*, const char*))
+{
+    SFDF_TRACE_SCOPE("sim_check_response");
+    modemLock lock(this);
     // if we receive topic from AWS, Serial2 will get message
     if(sim7600Port->available()>0)
     {
-        String received = sim7600Port->readString();
+        char received[256];
+        readResponse(received, sizeof(received), 1000);
         // AWS payload message will contain response and either ok or error
-        if(received.indexOf(check)>0)
+        if(strstr(received, check) != NULL)
         {
             printSerial();
             printSerialPort->println("Received response");
 
             // check if the sent message contains some String command, then do some function
-            if(received.indexOf(command1)>0)
+            if(strstr(received, command1) != NULL)
             {
                 func(command1, slaveName);
             }
-            else if(received.indexOf(command2)>0)
+            else if(strstr(received, command2) != NULL)
             {
                 func(command2, slaveName);
             }
-            
+
         }
     }
 }
-
-
-
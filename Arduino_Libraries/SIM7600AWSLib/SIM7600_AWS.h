@@ -4,6 +4,77 @@
 // Arduino Libraries
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <freertos/semphr.h>
+// Custom library, fixed-point sensor values from SFDFSensorLib
+#include <SFDFFixedPoint.h>
+#include <SFDFTelemetry.h>
+
+// Size of stack buffer AT commands are formatted into, longest is CMQTTCONNECT with the endpoint url
+#define SIM7600_CMD_BUFFER_SIZE 160
+
+// Size of stack buffer the sensor data JSON message is serialized into
+#define SIM7600_MSG_BUFFER_SIZE 200
+
+// Size of stack buffer each batch of aggregated node readings is written into, bigger batches are split into several publishes
+#define SIM7600_BATCH_BUFFER_SIZE 1024
+
+// Largest payload the SIM7600 takes in one AT+CMQTTPAYLOAD, longer messages are split into several publishes
+#define SIM7600_MAX_PAYLOAD 10240
+
+// Size of stack buffer streamed payloads are copied through on their way to the modem
+#define SIM7600_CHUNK_SIZE 128
+
+// Size of buffer waitResponse() collects the modem's reply in
+#define SIM7600_RESPONSE_BUFFER_SIZE 256
+
+// Size of buffer for getTime(), format is "YY/MM/DD,HH:MM:SS" plus null terminator
+#define SIM7600_TIME_STR_LEN 18
+
+// Number of messages each uplink lane of queueDataAWS() holds
+#define SIM7600_UPLINK_QUEUE_SIZE 4
+
+// Longest topic and message a queued uplink message can hold, including null terminator
+#define SIM7600_UPLINK_TOPIC_LEN 64
+#define SIM7600_UPLINK_MSG_LEN 256
+
+// After this many alarm/ack messages are sent in a row while bulk messages wait, one bulk message goes before the next one
+#define SIM7600_BULK_STARVATION_LIMIT 4
+
+// Longest topic and payload of a received MQTT message passed to the downlink handler, longer ones are cut off
+#define SIM7600_DOWNLINK_TOPIC_LEN 64
+#define SIM7600_DOWNLINK_PAYLOAD_LEN 256
+
+// Longest line the downlink parser keeps to match URCs like "+CMQTTRXPAYLOAD: 0,256", longer lines are cut off
+#define SIM7600_URC_LINE_LEN 48
+
+/**!
+ * @brief Called with every MQTT message received on a subscribed topic, see setDownlinkHandler()
+ * @param topic topic the message was published on
+ * @param payload message content, null terminated
+ */
+typedef void (*mqttMessageHandler)(const char* topic, const char* payload);
+
+/**!
+ * @brief Uplink lanes of queueDataAWS(), lower value is sent first
+ */
+enum uplinkPriority
+{
+    UPLINK_ALARM = 0,       // eg. low DO alarm
+    UPLINK_COMMAND_ACK,     // reply to a command from AWS
+    UPLINK_BULK,            // routine telemetry
+    UPLINK_LANES
+};
+
+/**!
+ * @brief Supplies the next part of a streamed payload, see streaming sendDataAWS()
+ * @param buffer where to write the next bytes
+ * @param size max bytes to write
+ * @param context pointer passed to sendDataAWS() (eg. a File)
+ * @return number of bytes written, 0 if there is no more data
+ */
+typedef size_t (*payloadWriter)(char* buffer, size_t size, void* context);
+
+class modemLock;
 
 class SIM7600AWS
 {
@@ -13,9 +84,165 @@ class SIM7600AWS
         Stream* sim7600Port; // The serial port that connects to AWS (eg. Serial2)
         Stream* printSerialPort; // The serial port to view response (eg. Serial)
         unsigned int baudRate;
-        bool is_sending_aws = false; // 
-        bool is_receiving_aws = false; 
-        
+        bool is_sending_aws = false; //
+        bool is_receiving_aws = false;
+
+        // uplink queue, see queueDataAWS()
+        struct uplinkMessage
+        {
+            char topic[SIM7600_UPLINK_TOPIC_LEN];
+            char message[SIM7600_UPLINK_MSG_LEN];
+            size_t length;
+            unsigned long queuedAt; // millis() when queued
+            bool ready;             // set once the message is copied in, the sender doesn't take the slot before
+        };
+
+        struct uplinkLane
+        {
+            uplinkMessage messages[SIM7600_UPLINK_QUEUE_SIZE] = {};
+            uint8_t head = 0;                   // oldest message
+            uint8_t count = 0;                  // slots taken, reserved by queueDataAWS() or ready
+            unsigned long maxLatency = 0;       // longest time from queued to published, in ms
+        };
+
+        uplinkLane lanes[UPLINK_LANES];
+        uint8_t bulkWaits = 0;      // alarm/ack messages sent in a row while bulk messages wait
+        bool uplinkBusy = false;    // a queued message is being sent, stops nested sending from the batch flush
+        // held to reserve, publish or free a slot, messages are copied in and sent outside of it
+        portMUX_TYPE uplinkLock = portMUX_INITIALIZER_UNLOCKED;
+
+        // only one task talks to the modem at a time, recursive so public functions can call each other, see modemLock
+        SemaphoreHandle_t portMutex;
+        uint8_t lockDepth = 0;                  // nesting of the task holding portMutex
+        volatile bool downlinkPending = false;  // processDownlink() found the port busy, the holder reads the port on release
+        friend class modemLock;
+
+        // downlink URC parser state, every byte read from the modem goes through parseDownlink()
+        enum urcState : uint8_t
+        {
+            URC_LINE,       // collecting a line
+            URC_TOPIC,      // taking rxRemaining bytes of topic after +CMQTTRXTOPIC
+            URC_PAYLOAD     // taking rxRemaining bytes of payload after +CMQTTRXPAYLOAD
+        };
+        urcState downlinkState = URC_LINE;
+        char urcLine[SIM7600_URC_LINE_LEN];
+        size_t urcLineLength = 0;
+        char rxTopic[SIM7600_DOWNLINK_TOPIC_LEN];
+        size_t rxTopicLength = 0;
+        char rxPayload[SIM7600_DOWNLINK_PAYLOAD_LEN];
+        size_t rxPayloadLength = 0;
+        size_t rxRemaining = 0;
+        unsigned long rxStartMicros = 0;
+        mqttMessageHandler downlinkHandler = nullptr;
+        uint32_t downlinkMessages = 0; // messages completed so far
+
+        /**!
+         * @brief Formats an AT command into a stack buffer and sends it with CRLF, nothing is allocated on the heap.
+         * @param format printf style command template (eg. "AT+CMQTTTOPIC=0,%u")
+         */
+        void sendCommand(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+        /**!
+         * @brief Sends raw bytes followed by CRLF, used for topic and payload input after AT+CMQTTTOPIC/AT+CMQTTPAYLOAD
+         * @param data bytes to send
+         * @param length number of bytes
+         */
+        void sendLine(const char* data, size_t length);
+
+        /**!
+         * @brief Reads response from SIM7600 into a buffer until no more bytes arrive within timeout, similar to readString() without allocating
+         * @param buffer output buffer, always null terminated
+         * @param size size of output buffer
+         * @param timeout how long to wait for the next byte in milliseconds
+         * @return number of bytes read
+         */
+        size_t readResponse(char* buffer, size_t size, unsigned long timeout);
+
+        // what waitReply() stopped on
+        enum modemReply : uint8_t
+        {
+            REPLY_TIMEOUT,
+            REPLY_EXPECTED, // expected text arrived
+            REPLY_FINAL,    // a line starting with the finalLine text arrived without the expected text, eg. a negative answer
+            REPLY_ERROR     // ERROR arrived
+        };
+
+        /**!
+         * @brief Reads response from SIM7600 until it contains expected text, a line starting with finalLine, ERROR or timeout.
+         * Commands that report their result in a URC with an error code (eg. "+CMQTTPUB: 0,<err>") pass the URC's start as
+         * finalLine, so a failure returns as soon as the modem reports it instead of waiting out the timeout.
+         * @param expected text that marks success (eg. "+CMQTTCONNECT: 0,0")
+         * @param finalLine start of a line that also ends the wait (eg. "+CMQTTCONNECT: 0,"), nullptr for none
+         * @param timeout max time to wait in milliseconds
+         * @param response optional buffer to get the full reply in, at least SIM7600_RESPONSE_BUFFER_SIZE long
+         * @return which of the above was seen first
+         */
+        modemReply waitReply(const char* expected, const char* finalLine, unsigned long timeout, char* response = nullptr);
+
+        /**!
+         * @brief Reads response from SIM7600 until it contains expected text, ERROR or timeout, instead of sleeping a fixed time
+         * @param expected text that marks success (eg. "OK")
+         * @param timeout max time to wait in milliseconds
+         * @param response optional buffer to get the full reply in, at least SIM7600_RESPONSE_BUFFER_SIZE long
+         * @return true if expected text was received
+         */
+        bool waitResponse(const char* expected, unsigned long timeout, char* response = nullptr);
+
+        /**!
+         * @brief Checks if SSL context 0 is already set up with the given certificate files
+         */
+        bool isSSLConfigured(const char* cacert, const char* clientcert, const char* clientkey);
+
+        /**!
+         * @brief True if the oldest message of a lane is copied in and can be sent, call with uplinkLock held
+         */
+        bool laneReady(int lane);
+
+        /**!
+         * @brief Picks the lane of the next queued message, strict priority except bulk goes once it waited SIM7600_BULK_STARVATION_LIMIT sends
+         * @param includeBulk false to only look at the alarm and command-ack lanes
+         * @return lane, -1 if nothing to send
+         */
+        int nextUplinkLane(bool includeBulk);
+
+        /**!
+         * @brief Publishes the oldest message of a lane and removes it, it stays queued if the modem didn't take it
+         * @return true if published
+         */
+        bool sendQueued(int lane);
+
+        /**!
+         * @brief Sends waiting alarm and command-ack messages, called between the messages of a batch flush so they don't wait for the whole batch
+         * @return number of messages published
+         */
+        int sendUrgent();
+
+
+        /**!
+         * @brief Feeds one byte from the modem to the URC parser, calls the downlink handler when a message is complete
+         * @return true if the byte was part of a received topic or payload, so it isn't part of a reply to a command
+         */
+        bool parseDownlink(char c);
+
+        /**!
+         * @brief Takes portMutex, waits for other tasks
+         */
+        void lockModem();
+
+        /**!
+         * @brief Gives portMutex back, the outermost release reads bytes a busy processDownlink() had to leave
+         */
+        void unlockModem();
+
+        /**!
+         * @brief Feeds every byte waiting on the port to the URC parser, portMutex must be held
+         */
+        void drainDownlink();
+
+        /**!
+         * @brief Acts on one complete line collected by parseDownlink()
+         */
+        void handleUrcLine();
 
     public:
 
@@ -26,51 +253,144 @@ class SIM7600AWS
          */
         SIM7600AWS(Stream *simPort, Stream *printPort);
 
-        /**!  
+        /**!
          * @brief Test function, send AT command and print a response to Serial
-         * @param String of AT command to send 
+         * @param AT command to send
         */
-       void testSim(String commnad);
+       void testSim(const char* command);
 
 
         /**!
-         * @brief Configures the SSL context, authenitciation mode, relevant certficates and keys. 
+         * @brief Configures the SSL context, authenitciation mode, relevant certficates and keys.
          * Assumes SIM7600 was already configured with certificates downloaded.
          * @param The CA certificate file name eg. if your cacert was set to cacert.pem, pass "cacert" to this parameter
          * @param The client certificate file name eg. if your client cert was set to clientcert.pem, pass "clientcert" to this parameter
          * @param The client key file name eg. if your client key was set to clientkey.pem, pass "clientkey" to this parameter
          */
-        void configureSSL(String cacert, String clientcert, String clientkey);
+        void configureSSL(const char* cacert, const char* clientcert, const char* clientkey);
 
         /**!
          * @brief Connects to AWS endpoint with MQTT
          * @param The clientName is the name to set this device
          * @param The awsEndpoint is the url link of the endpoint (eg. )
          */
-        void connectAWS(String clientName, String awsEndpoint);
+        void connectAWS(const char* clientName, const char* awsEndpoint);
+
+        /**!
+         * @brief Warm-start version of configureSSL() + connectAWS(). Asks the modem what is already set up (MQTT connection, MQTT client,
+         * SSL context, network) and only runs the missing steps, waiting on the modem's replies instead of fixed sleeps. After a brief ESP32
+         * brownout where the modem stayed up this takes a few hundred milliseconds, don't call disconnectAWS() before it.
+         * @param clientName name to set this device
+         * @param awsEndpoint url of the endpoint
+         * @param cacert CA certificate file name without .pem
+         * @param clientcert client certificate file name without .pem
+         * @param clientkey client key file name without .pem
+         * @return true if connected to AWS at the end
+         */
+        bool startAWS(const char* clientName, const char* awsEndpoint, const char* cacert, const char* clientcert, const char* clientkey);
+
+        /**!
+         * @brief Asks the modem if the MQTT client is connected
+         * @return true if connected
+         */
+        bool isConnectedAWS();
 
         /**!
-         * @brief Subscribe to MQTT topic from AWS 
-         * @param String of topic name to subscribe to
+         * @brief Subscribe to MQTT topic from AWS
+         * @param Topic name to subscribe to
         */
-        void subscribeTopic(String topic);
+        void subscribeTopic(const char* topic);
 
         /**!
          * @brief Sends a message to AWS with given topic
          * @param Publish topic of message
+         * @param Message content, null terminated
+         * @return true if published
+         */
+        bool sendDataAWS(const char* topic, const char* message);
+
+        /**!
+         * @brief Sends a message to AWS with given topic, message doesn't need to be null terminated
+         * @param Publish topic of message
          * @param Message content
+         * @param Length of message in bytes
+         * @return true if published
+         */
+        bool sendDataAWS(const char* topic, const char* message, size_t length);
+
+        /**!
+         * @brief Streaming version, payload doesn't have to be in RAM. After the modem's > prompt, writer is called repeatedly for the next
+         * SIM7600_CHUNK_SIZE bytes and they are passed straight to the modem (eg. read a backlog from flash). Payloads longer than
+         * SIM7600_MAX_PAYLOAD are split into several publishes on <topic>/part/<i>/<n>, i counting from 1, sending stops at the
+         * first part that fails.
+         * @param Publish topic of message
+         * @param Total length of payload in bytes
+         * @param writer function that supplies the payload
+         * @param context pointer passed to writer
+         * @return true if every part was published, false if the modem didn't answer, a publish failed or writer ran out of data
+         * early (the part is padded with spaces to the announced length but not published)
+         */
+        bool sendDataAWS(const char* topic, size_t length, payloadWriter writer, void* context);
+
+        /**!
+         * @brief Queues a message for processUplink() instead of sending it now. Each priority has its own lane, alarms go before
+         * command acks and both go before bulk, except a bulk message gets a turn after SIM7600_BULK_STARVATION_LIMIT higher
+         * priority sends in a row. The message is copied so the caller's buffer can be reused. Safe to call from another task.
+         * @param topic publish topic, shorter than SIM7600_UPLINK_TOPIC_LEN
+         * @param message null terminated message, shorter than SIM7600_UPLINK_MSG_LEN
+         * @param priority lane to queue in
+         * @return false if the lane is full or topic/message is too long
+         */
+        bool queueDataAWS(const char* topic, const char* message, uplinkPriority priority = UPLINK_BULK);
+
+        /**!
+         * @brief Publishes queued messages in priority order until all lanes are empty, call it often from loop().
+         * Priority is checked again before every message so an alarm queued meanwhile goes next.
+         * @return number of messages published, stops early if the modem doesn't take one
+         */
+        int processUplink();
+
+        /**!
+         * @return Number of messages waiting in a lane
          */
-        void sendDataAWS(String topic, String message);
+        size_t pendingUplink(uplinkPriority priority);
 
         /**!
-         * @brief Use this function for sending water sensor data, will format the data into JSON and send to AWS. Change parameters and JSON data if you want to add more or less data to send. 
+         * @return Longest time a message of this lane waited from queueDataAWS() until published, in milliseconds
+         */
+        unsigned long maxUplinkLatency(uplinkPriority priority);
+
+        /**!
+         * @brief Use this function for sending water sensor data, will format the data into JSON and send to AWS. Change parameters and JSON data if you want to add more or less data to send.
          * @param Publish topic name
          * @param pH value
          * @param EC value
          * @param DO value
-         * 
+         *
+        */
+        void sendSensorData(const char* topic, double ph, double ec, double do_data, double temperature);
+
+        /**!
+         * @brief Same as above but takes fixed-point values straight from sensorNodes (eg. readPhFixed()), values are formatted
+         * with integer math only so no software double emulation on the ESP32. Invalid readings are sent as null.
+         * @param Publish topic name
+         * @param pH value
+         * @param EC value
+         * @param DO value
+         * @param Temperature value
+        */
+        void sendSensorData(const char* topic, fixedValue ph, fixedValue ec, fixedValue do_data, fixedValue temperature);
+
+        /**!
+         * @brief Publishes readings aggregated from all sensor nodes (eg. ESP-Now slaves and this node) as combined JSON messages,
+         * so one cellular uplink serves the whole site. Each message holds as many nodes as fit in SIM7600_BATCH_BUFFER_SIZE.
+         * Queued alarm and command-ack messages are sent first and between the messages of the batch. Stops at the first failed
+         * publish, the nodes of that message and any after it stay in the aggregator for the next call.
+         * @param Publish topic name
+         * @param aggregator readings to publish, nodes are cleared once their message is published
+         * @return Number of messages published
         */
-        void sendSensorData(String topic, double ph, double ec, double do_data, double temperature);
+        int sendTelemetryBatch(const char* topic, telemetryAggregator& aggregator);
 
         /**!
          * @brief Gets the string of current time in UTC+8 from SIM7600
@@ -78,6 +398,14 @@ class SIM7600AWS
         */
         String getTime();
 
+        /**!
+         * @brief Same as above but writes into a buffer instead of returning a String
+         * @param buffer output buffer, should be at least SIM7600_TIME_STR_LEN long
+         * @param size size of output buffer
+         * @return true if time was read, false if response was not recognized (buffer is set to empty string)
+        */
+        bool getTime(char* buffer, size_t size);
+
         /**!
          * @brief Reset the SIM7600 module, then waits for around 35 seconds to let SIM reinitialize
          */
@@ -89,12 +417,37 @@ class SIM7600AWS
         void disconnectAWS();
 
         /**!
-         * @brief Handles incoming message from AWS, make sure to subscribe to topic beforehand. This example uses my ESP-Now custom library, feel free to change this function 
-         * @param command is the command to send to another ESP-Now node (eg. "PUMPON" to turn on pump)
+         * @brief Handles incoming message from AWS, make sure to subscribe to topic beforehand. This example uses my ESP-Now custom library, feel free to change this function.
+         * Polls and waits a second for the message to finish, see setDownlinkHandler() for handling messages as they arrive.
+         * @param check is the text that marks a message from AWS (eg. "response")
+         * @param command1 is the command to send to another ESP-Now node (eg. "PUMPON" to turn on pump)
+         * @param command2 is the second command to look for (eg. "PUMPOFF")
          * @param slaveName is the other ESP-Now SSID name to send to. If slaveName is "All", then will send to all connected ESP-Now peers
-         * @param func1 is self-defined function
+         * @param func is self-defined function, called with the matched command and slaveName
+         */
+        void checkResponseAWS(const char* check, const char* command1, const char* command2, const char* slaveName, void (&func)(const char*, const char*));
+
+        /**!
+         * @brief Sets the function called with every received MQTT message. The modem's +CMQTTRX URCs are parsed from every byte
+         * this library reads, so messages arriving in the middle of a publish are handled too. Runs in whatever task read the bytes,
+         * keep it short and use queueDataAWS() instead of publishing from it.
+         * @param handler function to call, nullptr to stop
+         */
+        void setDownlinkHandler(mqttMessageHandler handler);
+
+        /**!
+         * @brief Reads whatever the modem sent into the URC parser, meant to be called from a UART receive event
+         * (eg. Serial2.onReceive()) so commands from AWS are handled without waiting for loop(). Returns at once if another
+         * task is talking to the modem, that task passes the bytes to the parser instead, including any still waiting when it
+         * is done with the modem.
+         * @return number of messages handled
+         */
+        int processDownlink();
+
+        /**!
+         * @return micros() when the modem started reporting the message now being handled, for measuring command latency
          */
-        void checkResponseAWS(String check, String command1, String command2, String slaveName, void (&func)(String,String));
+        unsigned long downlinkReceivedAt();
 
         /* Below are some helper functions  */
 
@@ -110,11 +463,11 @@ class SIM7600AWS
         String readSerial();
 
         /**!
-         * @brief Another methodf for reading response from SIM7600 function 
+         * @brief Another methodf for reading response from SIM7600 function
         */
         String getResponse();
 
 };
 
 
-#endif
\ No newline at end of file
+#endif
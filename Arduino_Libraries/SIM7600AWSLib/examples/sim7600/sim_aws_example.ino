@@ -55,10 +55,10 @@ void loop() {
 }
 
 // Example of executing a function once it receives message from AWS
-void receivedMessage(String command ,String slaveName)
+void receivedMessage(const char* command ,const char* slaveName)
 {
     // do something
     Serial.println("Reached here from AWS message.");
-    Serial.println("Command was: " + command);
-    Seral.println("Send command to: " + slaveName);
+    Serial.print("Command was: "); Serial.println(command);
+    Serial.print("Send command to: "); Serial.println(slaveName);
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+/*
+Benchmark of the hot paths in the three SFDF libraries, runs on the ESP32 itself with a fake SIM7600 so no modem, sensors or
+other ESP32 are needed. Prints one CSV line per benchmark over Serial so results can be logged and compared before flashing a fleet:
+
+    BENCH,<name>,<iterations>,<ns_per_op>,<allocs_per_op>,<bytes_per_op>
+
+Allocation counts need ESP-IDF heap tracing (CONFIG_HEAP_TRACING_STANDALONE, eg. with PlatformIO or a custom sdkconfig),
+without it allocs_per_op and bytes_per_op are printed as -1. The same sketch also builds for Linux as the sfdf_benchmark target of
+host/CMakeLists.txt, where allocations are counted by the host allocator interposer instead.
+*/
+
+#include <ESP32NowLib.h>
+#include <SFDFSensor.h>
+#include "SIM7600_AWS.h"
+#include "fakeModem.h"
+
+#if defined(CONFIG_HEAP_TRACING_STANDALONE)
+#include <esp_heap_trace.h>
+#define BENCH_TRACE_RECORDS 300
+heap_trace_record_t traceRecords[BENCH_TRACE_RECORDS];
+#elif defined(SFDF_HOST)
+#include <allocCounter.h>
+#endif
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+
+// results of each op are written here so the compiler can't drop the work
+volatile uint32_t sink;
+
+/**!
+ * @brief Runs op iterations times and prints timing and allocation results as one CSV line
+ */
+void bench(const char* name, uint32_t iterations, void (*op)())
+{
+    // warm up caches once
+    op();
+
+    long allocs = -1;
+    long bytes = -1;
+#if defined(CONFIG_HEAP_TRACING_STANDALONE)
+    heap_trace_init_standalone(traceRecords, BENCH_TRACE_RECORDS);
+    heap_trace_start(HEAP_TRACE_ALL);
+#elif defined(SFDF_HOST)
+    allocCounter::start();
+#endif
+
+    unsigned long start = micros();
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        op();
+    }
+    unsigned long elapsed = micros() - start;
+
+#if defined(CONFIG_HEAP_TRACING_STANDALONE)
+    heap_trace_stop();
+    allocs = heap_trace_get_count();
+    bytes = 0;
+    for (long i = 0; i < allocs; ++i)
+    {
+        heap_trace_record_t record;
+        heap_trace_get(i, &record);
+        bytes += record.size;
+    }
+    allocs /= iterations;
+    bytes /= iterations;
+#elif defined(SFDF_HOST)
+    allocCounter::stop();
+    allocs = allocCounter::count() / iterations;
+    bytes = allocCounter::bytes() / iterations;
+#endif
+
+    Serial.printf("BENCH,%s,%lu,%lu,%ld,%ld\n", name, (unsigned long)iterations, (unsigned long)((uint64_t)elapsed * 1000 / iterations), allocs, bytes);
+}
+
+/* sensorNodes decoding, register value to text */
+
+void decodeDouble()
+{
+    // what readPh() + ArduinoJson do, software double divide and format
+    char text[16];
+    double value = double(712 + (sink & 7)) / 100;
+    snprintf(text, sizeof(text), "%.2f", value);
+    sink = text[0];
+}
+
+void decodeFixed()
+{
+    char text[FIXED_VALUE_STR_LEN];
+    fixedValue value = {int32_t(712 + (sink & 7)), 2, true};
+    formatFixed(text, sizeof(text), value);
+    sink = text[0];
+}
+
+/* averaging a window of readings before publishing, the aggregation step of the pipeline */
+
+#define BENCH_AVERAGE_WINDOW 16
+
+void averageDouble()
+{
+    // what averaging readPh() results does, software double divide per reading and for the mean
+    double sum = 0;
+    for (uint8_t i = 0; i < BENCH_AVERAGE_WINDOW; ++i)
+    {
+        sum += double(700 + ((sink + i) & 31)) / 100;
+    }
+    char text[16];
+    snprintf(text, sizeof(text), "%.2f", sum / BENCH_AVERAGE_WINDOW);
+    sink = text[0];
+}
+
+void averageFixedValues()
+{
+    fixedValue values[BENCH_AVERAGE_WINDOW];
+    for (uint8_t i = 0; i < BENCH_AVERAGE_WINDOW; ++i)
+    {
+        values[i] = {int32_t(700 + ((sink + i) & 31)), 2, true};
+    }
+    char text[FIXED_VALUE_STR_LEN];
+    formatFixed(text, sizeof(text), averageFixed(values, BENCH_AVERAGE_WINDOW));
+    sink = text[0];
+}
+
+/* sendSensorData JSON building and publish against the fake modem */
+
+void publishSensorDouble()
+{
+    aws.sendSensorData("sfdf/client01/sensor_data", 7.12, 850.0, 6.2, 23.15);
+}
+
+void publishSensorFixed()
+{
+    fixedValue ph = {712, 2, true};
+    fixedValue ec = {850, 0, true};
+    fixedValue do_data = {6200, 3, true};
+    fixedValue temperature = {2315, 2, true};
+    aws.sendSensorData("sfdf/client01/sensor_data", ph, ec, do_data, temperature);
+}
+
+/* event driven downlink, URC parsing of a received MQTT message and handing it to the handler. The polling checkResponseAWS()
+   is not timed, its readResponse() waits for a second of silence so the row would only measure that timeout. */
+
+void onDownlink(const char* topic, const char* payload)
+{
+    sink = payload[0];
+}
+
+void downlinkDispatch()
+{
+    modem.setReply("+CMQTTRXSTART: 0,21,21\r\n+CMQTTRXTOPIC: 0,21\r\nsfdf/client01/command\r\n+CMQTTRXPAYLOAD: 0,21\r\n{\"response\":\"PUMPON\"}\r\n+CMQTTRXEND: 0\r\n");
+    aws.processDownlink();
+}
+
+/* ESP32Now frame handling, queue hand-off, relay routing and telemetry frames */
+
+ringBuffer<espNowFrame, ESPNOW_RX_QUEUE_SIZE> queue;
+relayRouter router;
+uint16_t relaySeq = 0;
+
+void queueFrame()
+{
+    espNowFrame* frame = queue.writeSlot();
+    frame->length = 6;
+    memcpy(frame->data, "PUMPON", 7);
+    queue.commitWrite();
+    frame = queue.readSlot();
+    sink = frame->data[0];
+    queue.commitRead();
+}
+
+/* the same hand-off across two tasks, a producer task in place of the WiFi task and setup() as the dispatcher */
+
+#define BENCH_HANDOFF_FRAMES 20000
+
+ringBuffer<espNowFrame, ESPNOW_RX_QUEUE_SIZE> handoff;
+
+void handoffProducer(void* param)
+{
+    for (uint32_t i = 0; i < BENCH_HANDOFF_FRAMES; ++i)
+    {
+        espNowFrame* frame;
+        while ((frame = handoff.writeSlot()) == nullptr)
+        {
+            taskYIELD();
+        }
+        frame->length = 6;
+        memcpy(frame->data, "PUMPON", 7);
+        frame->rxTime = esp_timer_get_time();
+        handoff.commitWrite();
+    }
+    vTaskDelete(nullptr);
+}
+
+/**!
+ * @brief Prints frames per second through the queue across tasks as ns per frame, and the mean and worst time a frame
+ * waited in the queue. Allocations are not counted, the producer task's stack would show up.
+ */
+void benchHandoff()
+{
+    int64_t waitSum = 0;
+    int64_t waitMax = 0;
+    unsigned long start = micros();
+    xTaskCreate(handoffProducer, "bench_producer", 4096, nullptr, 1, nullptr);
+    for (uint32_t received = 0; received < BENCH_HANDOFF_FRAMES; )
+    {
+        espNowFrame* frame = handoff.readSlot();
+        if (frame == nullptr)
+        {
+            taskYIELD();
+            continue;
+        }
+        int64_t wait = esp_timer_get_time() - frame->rxTime;
+        waitSum += wait;
+        waitMax = max(waitMax, wait);
+        sink = frame->data[0];
+        handoff.commitRead();
+        ++received;
+    }
+    unsigned long elapsed = micros() - start;
+
+    Serial.printf("BENCH,espnow_queue_handoff,%lu,%lu,-1,-1\n", (unsigned long)BENCH_HANDOFF_FRAMES,
+                  (unsigned long)((uint64_t)elapsed * 1000 / BENCH_HANDOFF_FRAMES));
+    Serial.printf("BENCH,espnow_queue_handoff_wait,%lu,%lu,-1,-1\n", (unsigned long)BENCH_HANDOFF_FRAMES,
+                  (unsigned long)(waitSum * 1000 / BENCH_HANDOFF_FRAMES));
+    Serial.printf("BENCH,espnow_queue_handoff_wait_max,1,%lu,-1,-1\n", (unsigned long)(waitMax * 1000));
+}
+
+void relayRoute()
+{
+    static const uint8_t via[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0x01, 0x02, 0x03};
+    uint8_t origin = relaySeq & 7;
+    if (!router.isDuplicate(origin, ++relaySeq))
+    {
+        router.learnRoute(origin, via, 2, millis());
+    }
+    sink = router.nextHop(origin, millis()) != nullptr;
+}
+
+void telemetryFrame()
+{
+    sensorReading reading = {{712, 2, true}, {850, 0, true}, {6200, 3, true}, {2315, 2, true}};
+    char frame[TELEMETRY_FRAME_LEN];
+    encodeTelemetry(frame, sizeof(frame), 3, reading);
+    uint8_t nodeId;
+    decodeTelemetry(frame + sizeof(TELEMETRY_COMMAND), nodeId, reading);
+    sink = nodeId;
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(1000);
+    router.begin(0);
+
+    Serial.println("BENCH,name,iterations,ns_per_op,allocs_per_op,bytes_per_op");
+    bench("sensor_decode_double", 10000, decodeDouble);
+    bench("sensor_decode_fixed", 10000, decodeFixed);
+    bench("sensor_average_double", 10000, averageDouble);
+    bench("sensor_average_fixed", 10000, averageFixedValues);
+    bench("publish_sensor_double", 200, publishSensorDouble);
+    bench("publish_sensor_fixed", 200, publishSensorFixed);
+    aws.setDownlinkHandler(onDownlink);
+    bench("downlink_urc_dispatch", 10000, downlinkDispatch);
+    aws.setDownlinkHandler(nullptr);
+    bench("espnow_queue_frame", 10000, queueFrame);
+    benchHandoff();
+    bench("espnow_relay_route", 10000, relayRoute);
+    bench("telemetry_encode_decode", 10000, telemetryFrame);
+    Serial.println("BENCH,done");
+}
+
+void loop()
+{
+}
\ No newline at end of file
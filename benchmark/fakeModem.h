@@ -0,0 +1,349 @@
+/* Fake SIM7600 and a throwaway Print for running the SIM7600AWS library without a modem, shared by the benchmark sketch and the
+   host tests in host/tests */
+
+#ifndef SFDF_FAKE_MODEM_H
+#define SFDF_FAKE_MODEM_H
+
+#include <Arduino.h>
+
+// Bytes of reply waiting to be read, URCs injected with appendReply() have to fit too
+#define FAKE_MODEM_REPLY_LEN 512
+
+// Commands received are logged up to this many bytes, see sent()
+#define FAKE_MODEM_LOG_LEN 1024
+
+// Topic and payload of the last publish are kept up to these lengths, longer payloads are still counted
+#define FAKE_MODEM_TOPIC_LEN 128
+#define FAKE_MODEM_PAYLOAD_LEN 2048
+
+/*
+ Fake SIM7600 that answers every AT command at once with a canned reply, so benchmarks measure the library and not the modem.
+ Keeps the topic and payload of the last publish so tests can check what was sent. The SSL, network and MQTT state that
+ startAWS() queries is kept too, so tests can set up what the modem remembers from before an ESP32 reset.
+*/
+class fakeModem : public Stream
+{
+    private:
+        char line[128];
+        size_t lineLength = 0;
+        char reply[FAKE_MODEM_REPLY_LEN];
+        size_t replyLength = 0;
+        size_t replyPos = 0;
+
+        // topic/payload bytes still expected after a > prompt, and where they go
+        size_t inputRemaining = 0;
+        bool inputIsTopic = false;
+
+        char log[FAKE_MODEM_LOG_LEN];
+        size_t logLength = 0;
+
+        char topic[FAKE_MODEM_TOPIC_LEN];
+        size_t topicLength = 0;
+        char payload[FAKE_MODEM_PAYLOAD_LEN];
+        size_t payloadLength = 0;
+
+        void logLine()
+        {
+            if (logLength + lineLength + 2 > sizeof(log))
+            {
+                logLength = 0;
+            }
+            memcpy(log + logLength, line, lineLength);
+            logLength += lineLength;
+            log[logLength++] = '\n';
+            log[logLength] = 0;
+        }
+
+        // CSSLCFG="<name>",0,"<file>", remembers the file for the certificate settings
+        void setCertificate(const char* name, char* file, size_t size)
+        {
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "AT+CSSLCFG=\"%s\",0,\"", name);
+            if (strncmp(line, prefix, strlen(prefix)) == 0)
+            {
+                snprintf(file, size, "%s", line + strlen(prefix));
+                char* quote = strchr(file, '"');
+                if (quote != nullptr)
+                {
+                    *quote = 0;
+                }
+            }
+        }
+
+        // answers for the commands startAWS() uses, false if line isn't one of them
+        bool onSetupLine()
+        {
+            char text[160];
+            if (strcmp(line, "AT+CSSLCFG=0") == 0)
+            {
+                snprintf(text, sizeof(text), "+CSSLCFG: 0,4,2,0,0,0,0,\"%s\",\"%s\",\"%s\",0,0,0\r\n\r\nOK\r\n", cacert, clientcert, clientkey);
+                appendReply(text);
+            }
+            else if (strncmp(line, "AT+CSSLCFG=\"", 12) == 0)
+            {
+                setCertificate("cacert", cacert, sizeof(cacert));
+                setCertificate("clientcert", clientcert, sizeof(clientcert));
+                setCertificate("clientkey", clientkey, sizeof(clientkey));
+                appendReply("OK\r\n");
+            }
+            else if (strcmp(line, "AT+NETOPEN?") == 0)
+            {
+                appendReply(networkOpen ? "+NETOPEN: 1\r\n\r\nOK\r\n" : "+NETOPEN: 0\r\n\r\nOK\r\n");
+            }
+            else if (strcmp(line, "AT+NETOPEN") == 0)
+            {
+                appendReply(networkOpen ? "+IP ERROR: Network is already opened\r\n\r\nERROR\r\n" : "OK\r\n\r\n+NETOPEN: 0\r\n");
+                networkOpen = true;
+            }
+            else if (strcmp(line, "AT+CMQTTSTART") == 0)
+            {
+                appendReply(mqttStarted ? "+CMQTTSTART: 23\r\n\r\nERROR\r\n" : "OK\r\n\r\n+CMQTTSTART: 0\r\n");
+                mqttStarted = true;
+            }
+            else if (strcmp(line, "AT+CMQTTSTOP") == 0)
+            {
+                mqttStarted = false;
+                mqttConnected = false;
+                mqttClient[0] = 0;
+                appendReply("OK\r\n\r\n+CMQTTSTOP: 0\r\n");
+            }
+            else if (strcmp(line, "AT+CMQTTACCQ?") == 0)
+            {
+                if (!mqttStarted)
+                {
+                    appendReply("ERROR\r\n");
+                    return true;
+                }
+                snprintf(text, sizeof(text), "+CMQTTACCQ: 0,\"%s\",1\r\n+CMQTTACCQ: 1,\"\",0\r\n\r\nOK\r\n", mqttClient);
+                appendReply(text);
+            }
+            else if (strncmp(line, "AT+CMQTTACCQ=0,\"", 16) == 0)
+            {
+                if (!mqttStarted || mqttClient[0] != 0)
+                {
+                    appendReply("ERROR\r\n");
+                    return true;
+                }
+                snprintf(mqttClient, sizeof(mqttClient), "%s", line + 16);
+                char* quote = strchr(mqttClient, '"');
+                if (quote != nullptr)
+                {
+                    *quote = 0;
+                }
+                appendReply("OK\r\n");
+            }
+            else if (strcmp(line, "AT+CMQTTREL=0") == 0)
+            {
+                mqttClient[0] = 0;
+                mqttConnected = false;
+                appendReply("OK\r\n");
+            }
+            else if (strcmp(line, "AT+CMQTTDISC?") == 0)
+            {
+                appendReply(mqttConnected ? "+CMQTTDISC: 0,0\r\n+CMQTTDISC: 1,1\r\n\r\nOK\r\n" : "+CMQTTDISC: 0,1\r\n+CMQTTDISC: 1,1\r\n\r\nOK\r\n");
+            }
+            else if (strncmp(line, "AT+CMQTTDISC=0", 14) == 0)
+            {
+                mqttConnected = false;
+                appendReply("OK\r\n\r\n+CMQTTDISC: 0,0\r\n");
+            }
+            else if (strncmp(line, "AT+CMQTTCONNECT=0", 17) == 0)
+            {
+                // needs SSL set up, an open network, the MQTT service and a client, 6 is the modem's "failed to connect" code
+                mqttConnected = networkOpen && mqttStarted && mqttClient[0] != 0 && cacert[0] != 0 && clientcert[0] != 0 && clientkey[0] != 0;
+                appendReply(mqttConnected ? "OK\r\n\r\n+CMQTTCONNECT: 0,0\r\n" : "OK\r\n\r\n+CMQTTCONNECT: 0,6\r\n");
+            }
+            else
+            {
+                return false;
+            }
+            return true;
+        }
+
+        void onLine()
+        {
+            line[lineLength] = 0;
+            logLine();
+            if (onSetupLine())
+            {
+            }
+            else if (strncmp(line, "AT+CCLK?", 8) == 0)
+            {
+                appendReply("+CCLK: \"23/04/14,12:42:16+32\"\r\nOK\r\n");
+            }
+            else if (strncmp(line, "AT+CMQTTTOPIC", 13) == 0 || strncmp(line, "AT+CMQTTPAYLOAD", 15) == 0)
+            {
+                // like the real modem, take exactly the announced number of bytes as topic/payload, then answer OK
+                inputRemaining = atoi(strchr(line, ',') + 1);
+                inputIsTopic = line[8] == 'T';
+                if (inputIsTopic)
+                {
+                    topicLength = 0;
+                }
+                else
+                {
+                    payloadLength = 0;
+                }
+                appendReply(">");
+            }
+            else if (strncmp(line, "AT+CMQTTPUB", 11) == 0)
+            {
+                topic[min(topicLength, sizeof(topic) - 1)] = 0;
+                payload[min(payloadLength, sizeof(payload) - 1)] = 0;
+                if (onPublish != nullptr)
+                {
+                    onPublish();
+                }
+                delay(publishDelay);
+                if (failPublishes > 0)
+                {
+                    // 11 is the modem's "publish failed" code
+                    --failPublishes;
+                    appendReply("OK\r\n+CMQTTPUB: 0,11\r\n");
+                }
+                else
+                {
+                    ++publishes;
+                    appendReply("OK\r\n+CMQTTPUB: 0,0\r\n");
+                }
+                if (afterPublish != nullptr)
+                {
+                    appendReply(afterPublish);
+                }
+            }
+            else if (strncmp(line, "AT", 2) == 0)
+            {
+                appendReply("OK\r\n");
+            }
+            lineLength = 0;
+        }
+
+        void onInput(uint8_t c)
+        {
+            if (inputIsTopic)
+            {
+                if (topicLength + 1 < sizeof(topic))
+                {
+                    topic[topicLength] = c;
+                }
+                ++topicLength;
+            }
+            else
+            {
+                if (payloadLength + 1 < sizeof(payload))
+                {
+                    payload[payloadLength] = c;
+                }
+                ++payloadLength;
+            }
+            if (--inputRemaining == 0)
+            {
+                appendReply("\r\nOK\r\n");
+            }
+        }
+
+    public:
+        unsigned long publishDelay = 0;     // simulated cellular round trip of each publish, in ms
+        void (*onPublish)() = nullptr;      // called on every publish, to inject events in the middle of a send
+        int failPublishes = 0;              // this many of the next publishes fail
+        const char* afterPublish = nullptr; // sent after every publish result, eg. a URC arriving once the library stopped reading
+        uint32_t publishes = 0;             // publishes that went through
+
+        // what the modem has set up, the startAWS() queries report this and its set up commands change it
+        char cacert[32] = "";               // certificate files of SSL context 0, eg. "cacert.pem"
+        char clientcert[32] = "";
+        char clientkey[32] = "";
+        bool networkOpen = false;
+        bool mqttStarted = false;
+        char mqttClient[32] = "";           // name of MQTT client 0, empty if none acquired
+        bool mqttConnected = false;
+
+        /**!
+         * @brief Checks if a command was sent since the last clearLog()
+         * @param command start of the command line, eg. "AT+NETOPEN" also matches "AT+NETOPEN?"
+         */
+        bool sent(const char* command)
+        {
+            size_t length = strlen(command);
+            for (const char* at = log; at < log + logLength; at = strchr(at, '\n') + 1)
+            {
+                if (strncmp(at, command, length) == 0)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void clearLog()
+        {
+            logLength = 0;
+            log[0] = 0;
+        }
+
+        /**!
+         * @brief Replace whatever reply is still waiting
+         */
+        void setReply(const char* text)
+        {
+            replyLength = 0;
+            replyPos = 0;
+            appendReply(text);
+        }
+
+        /**!
+         * @brief Add to the waiting reply, eg. a URC arriving while the library waits for something else
+         */
+        void appendReply(const char* text)
+        {
+            if (replyPos > 0)
+            {
+                memmove(reply, reply + replyPos, replyLength - replyPos);
+                replyLength -= replyPos;
+                replyPos = 0;
+            }
+            size_t length = min(strlen(text), sizeof(reply) - replyLength);
+            memcpy(reply + replyLength, text, length);
+            replyLength += length;
+        }
+
+        // topic and payload of the last publish, payload is cut at FAKE_MODEM_PAYLOAD_LEN but its length is not
+        const char* publishedTopic() { return topic; }
+        const char* publishedPayload() { return payload; }
+        size_t publishedLength() { return payloadLength; }
+
+        using Print::write;
+        size_t write(uint8_t c) override
+        {
+            if (inputRemaining > 0)
+            {
+                onInput(c);
+            }
+            else if (c == '\n')
+            {
+                onLine();
+            }
+            else if (c != '\r' && lineLength + 1 < sizeof(line))
+            {
+                line[lineLength++] = c;
+            }
+            return 1;
+        }
+
+        int available() override { return replyLength - replyPos; }
+        int read() override { return replyPos < replyLength ? reply[replyPos++] : -1; }
+        int peek() override { return replyPos < replyLength ? reply[replyPos] : -1; }
+};
+
+// Throwaway output so debug prints from the library don't cost UART time
+class nullPrint : public Stream
+{
+    public:
+        using Print::write;
+        size_t write(uint8_t) override { return 1; }
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+};
+
+#endif
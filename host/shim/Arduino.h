@@ -0,0 +1,189 @@
+/* Host build stand-in for the Arduino core, only what the SFDF libraries use. Not a full Arduino API. */
+
+#ifndef SFDF_HOST_ARDUINO_H
+#define SFDF_HOST_ARDUINO_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdarg>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+
+/**!
+ * @brief Arduino String on top of std::string, allocates like the real one does
+ */
+class String
+{
+    private:
+        std::string text;
+
+    public:
+        String() {}
+        String(const char* value): text(value != nullptr ? value : "") {}
+        String(const std::string& value): text(value) {}
+        String(char value): text(1, value) {}
+        explicit String(int value): text(std::to_string(value)) {}
+        explicit String(unsigned value): text(std::to_string(value)) {}
+        explicit String(long value): text(std::to_string(value)) {}
+        explicit String(unsigned long value): text(std::to_string(value)) {}
+
+        unsigned length() const { return text.size(); }
+        const char* c_str() const { return text.c_str(); }
+        int indexOf(const String& other) const { size_t pos = text.find(other.text); return pos == std::string::npos ? -1 : int(pos); }
+        String substring(unsigned from, unsigned to) const { return text.substr(from, to - from); }
+        String substring(unsigned from) const { return text.substr(from); }
+        bool startsWith(const String& other) const { return text.compare(0, other.text.size(), other.text) == 0; }
+        void trim()
+        {
+            size_t first = text.find_first_not_of(" \t\r\n");
+            size_t last = text.find_last_not_of(" \t\r\n");
+            text = first == std::string::npos ? "" : text.substr(first, last - first + 1);
+        }
+        bool operator==(const char* other) const { return text == other; }
+        bool operator!=(const char* other) const { return text != other; }
+        String& operator+=(const String& other) { text += other.text; return *this; }
+        String& operator+=(char c) { text += c; return *this; }
+        char operator[](unsigned index) const { return text[index]; }
+        friend String operator+(const String& a, const String& b) { return a.text + b.text; }
+};
+
+/**!
+ * @brief Arduino Print, everything ends up in write()
+ */
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                write(buffer[i]);
+            }
+            return size;
+        }
+        size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+        virtual void flush() {}
+
+        size_t print(const char* text) { return write(text, strlen(text)); }
+        size_t print(const String& text) { return print(text.c_str()); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int value) { return printf("%d", value); }
+        size_t print(unsigned value) { return printf("%u", value); }
+        size_t print(long value) { return printf("%ld", value); }
+        size_t print(unsigned long value) { return printf("%lu", value); }
+        size_t print(double value, int digits = 2) { return printf("%.*f", digits, value); }
+
+        size_t println() { return print("\r\n"); }
+        template <typename T> size_t println(const T& value) { return print(value) + println(); }
+        size_t println(double value, int digits) { return print(value, digits) + println(); }
+
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            char buffer[256];
+            va_list args;
+            va_start(args, format);
+            int length = vsnprintf(buffer, sizeof(buffer), format, args);
+            va_end(args);
+            return length > 0 ? write(buffer, min((size_t)length, sizeof(buffer) - 1)) : 0;
+        }
+};
+
+/**!
+ * @brief Arduino Stream, blocking reads give up after the timeout like on the board
+ */
+class Stream : public Print
+{
+    protected:
+        unsigned long timeout = 1000;
+
+        int timedRead()
+        {
+            unsigned long start = millis();
+            while (millis() - start < timeout)
+            {
+                if (available() > 0)
+                {
+                    return read();
+                }
+                yield();
+            }
+            return -1;
+        }
+
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+
+        void setTimeout(unsigned long ms) { timeout = ms; }
+
+        size_t readBytes(char* buffer, size_t length)
+        {
+            size_t count = 0;
+            int c;
+            while (count < length && (c = timedRead()) >= 0)
+            {
+                buffer[count++] = (char)c;
+            }
+            return count;
+        }
+
+        String readString()
+        {
+            String text;
+            int c;
+            while ((c = timedRead()) >= 0)
+            {
+                text += (char)c;
+            }
+            return text;
+        }
+};
+
+/**!
+ * @brief Serial ports print to stdout and never receive anything
+ */
+class HardwareSerial : public Stream
+{
+    public:
+        using Print::write;
+        size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        void begin(unsigned long, uint32_t = 0, int = -1, int = -1) {}
+        void onReceive(void (*)(), bool = false) {}
+};
+
+#define SERIAL_8N1 0x800001c
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+
+class EspClass
+{
+    public:
+        void restart() { exit(1); }
+        uint32_t getFreeHeap() { return 0; }
+};
+extern EspClass ESP;
+
+#endif
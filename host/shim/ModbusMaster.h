@@ -0,0 +1,38 @@
+/* Host build stand-in for ModbusMaster, holding registers are set by the test with hostSetRegister() */
+
+#ifndef SFDF_HOST_MODBUSMASTER_H
+#define SFDF_HOST_MODBUSMASTER_H
+
+#include <Arduino.h>
+
+class ModbusMaster
+{
+    private:
+        uint16_t registers[0x100] = {};
+        uint16_t response = 0;
+        bool failing = false;
+
+    public:
+        static const uint8_t ku8MBSuccess = 0x00;
+        static const uint8_t ku8MBResponseTimedOut = 0xE2;
+
+        void begin(uint8_t, Stream&) {}
+
+        uint8_t readHoldingRegisters(uint16_t address, uint16_t)
+        {
+            if (failing)
+            {
+                return ku8MBResponseTimedOut;
+            }
+            response = registers[address & 0xff];
+            return ku8MBSuccess;
+        }
+
+        uint16_t getResponseBuffer(uint8_t) { return response; }
+
+        // Host only
+        void hostSetRegister(uint16_t address, uint16_t value) { registers[address & 0xff] = value; }
+        void hostSetFailing(bool fail) { failing = fail; }
+};
+
+#endif
@@ -0,0 +1,63 @@
+/* Host build stand-in for the arduino-esp32 WiFi class, scans return the networks added with hostAddNetwork() */
+
+#ifndef SFDF_HOST_WIFI_H
+#define SFDF_HOST_WIFI_H
+
+#include <Arduino.h>
+#include "esp_wifi.h"
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+#define WIFI_HOST_MAX_NETWORKS 8
+
+class WiFiClass
+{
+    private:
+        struct network
+        {
+            char ssid[33];
+            uint8_t bssid[6];
+            int32_t rssi;
+        };
+        network networks[WIFI_HOST_MAX_NETWORKS];
+        int networkCount = 0;
+
+    public:
+        bool mode(wifi_mode_t) { return true; }
+        bool softAP(const String&, const char*, int = 1, int = 0) { return true; }
+        bool softAP(const char*, const char*, int = 1, int = 0) { return true; }
+        int32_t channel() { return 1; }
+        bool disconnect() { return true; }
+
+        int16_t scanNetworks(bool = false, bool = false, bool = false, uint32_t = 300, uint8_t = 0) { return networkCount; }
+        void scanDelete() {}
+        String SSID(int i) { return String(networks[i].ssid); }
+        int32_t RSSI(int i) { return networks[i].rssi; }
+        uint8_t* BSSID(int i) { return networks[i].bssid; }
+        String BSSIDstr(int i)
+        {
+            char text[18];
+            const uint8_t* m = networks[i].bssid;
+            snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+            return String(text);
+        }
+
+        // Host only, make a network show up in scans
+        void hostAddNetwork(const char* ssid, const uint8_t* bssid, int32_t rssi)
+        {
+            if (networkCount < WIFI_HOST_MAX_NETWORKS)
+            {
+                snprintf(networks[networkCount].ssid, sizeof(networks[networkCount].ssid), "%s", ssid);
+                memcpy(networks[networkCount].bssid, bssid, 6);
+                networks[networkCount].rssi = rssi;
+                ++networkCount;
+            }
+        }
+
+        // Host only, forget all networks
+        void hostClearNetworks() { networkCount = 0; }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,107 @@
+#include "allocCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// glibc's own allocator entry points, the interposed versions below forward to them
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void* pointer);
+
+static std::atomic<bool> counting(false);
+static std::atomic<long> allocations(0);
+static std::atomic<long> allocatedBytes(0);
+
+static void note(size_t size)
+{
+    if (counting.load(std::memory_order_relaxed))
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add((long)size, std::memory_order_relaxed);
+    }
+}
+
+void allocCounter::start()
+{
+    allocations = 0;
+    allocatedBytes = 0;
+    counting = true;
+}
+
+void allocCounter::stop()
+{
+    counting = false;
+}
+
+long allocCounter::count()
+{
+    return allocations;
+}
+
+long allocCounter::bytes()
+{
+    return allocatedBytes;
+}
+
+extern "C" void* malloc(size_t size)
+{
+    note(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    note(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    note(size);
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer)
+{
+    __libc_free(pointer);
+}
+
+static void* allocate(size_t size)
+{
+    void* pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+static void* allocateAligned(size_t size, std::align_val_t alignment)
+{
+    note(size);
+    void* pointer = __libc_memalign((size_t)alignment, size == 0 ? 1 : size);
+    if (pointer == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return malloc(size == 0 ? 1 : size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return malloc(size == 0 ? 1 : size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void operator delete(void* pointer) noexcept { free(pointer); }
+void operator delete[](void* pointer) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { free(pointer); }
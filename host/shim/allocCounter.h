@@ -0,0 +1,29 @@
+/* Host only, counts heap allocations by interposing malloc/calloc/realloc and every operator new. Needs glibc. */
+
+#ifndef SFDF_HOST_ALLOC_COUNTER_H
+#define SFDF_HOST_ALLOC_COUNTER_H
+
+namespace allocCounter
+{
+    /**!
+     * @brief Zeroes the counters and starts counting allocations made from any thread
+     */
+    void start();
+
+    /**!
+     * @brief Stops counting, counters keep their values
+     */
+    void stop();
+
+    /**!
+     * @brief Number of allocations since start()
+     */
+    long count();
+
+    /**!
+     * @brief Bytes requested by those allocations
+     */
+    long bytes();
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* Host build stand-in for ESP-Now. Sends are recorded so tests can check what went on air. */
+
+#ifndef SFDF_HOST_ESP_NOW_H
+#define SFDF_HOST_ESP_NOW_H
+
+#include <cstdint>
+#include <cstddef>
+#include "esp_wifi.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_ESPNOW_BASE 0x3000
+#define ESP_ERR_ESPNOW_NOT_INIT (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG (ESP_ERR_ESPNOW_BASE + 2)
+#define ESP_ERR_ESPNOW_NO_MEM (ESP_ERR_ESPNOW_BASE + 3)
+#define ESP_ERR_ESPNOW_FULL (ESP_ERR_ESPNOW_BASE + 4)
+#define ESP_ERR_ESPNOW_NOT_FOUND (ESP_ERR_ESPNOW_BASE + 5)
+#define ESP_ERR_ESPNOW_INTERNAL (ESP_ERR_ESPNOW_BASE + 6)
+#define ESP_ERR_ESPNOW_EXIST (ESP_ERR_ESPNOW_BASE + 7)
+
+#define ESP_NOW_ETH_ALEN 6
+#define ESP_NOW_MAX_DATA_LEN 250
+#define ESP_NOW_MAX_TOTAL_PEER_NUM 20
+
+typedef enum { ESP_NOW_SEND_SUCCESS = 0, ESP_NOW_SEND_FAIL } esp_now_send_status_t;
+
+typedef struct
+{
+    uint8_t peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t lmk[16];
+    uint8_t channel;
+    wifi_interface_t ifidx;
+    bool encrypt;
+    void* priv;
+} esp_now_peer_info_t;
+
+typedef void (*esp_now_send_cb_t)(const uint8_t* mac_addr, esp_now_send_status_t status);
+typedef void (*esp_now_recv_cb_t)(const uint8_t* mac_addr, const uint8_t* data, int data_len);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t callback);
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback);
+bool esp_now_is_peer_exist(const uint8_t* mac);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer);
+esp_err_t esp_now_del_peer(const uint8_t* mac);
+esp_err_t esp_now_fetch_peer(bool fromHead, esp_now_peer_info_t* peer);
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t length);
+
+/**!
+ * @brief Host only, one frame handed to esp_now_send(), a send to all peers is recorded once per peer
+ */
+struct espNowHostFrame
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    uint8_t length;
+    uint8_t data[ESP_NOW_MAX_DATA_LEN];
+};
+
+// Host only, frames sent so far, oldest are overwritten after ESPNOW_HOST_LOG_SIZE
+#define ESPNOW_HOST_LOG_SIZE 64
+extern espNowHostFrame espNowHostLog[ESPNOW_HOST_LOG_SIZE];
+extern size_t espNowHostLogCount;
+
+// Host only, forget all peers, callbacks and logged frames
+void espNowHostReset();
+
+// Host only, deliver a frame to the registered receive callback as if it came from mac
+void espNowHostReceive(const uint8_t* mac, const uint8_t* data, int length);
+
+#endif
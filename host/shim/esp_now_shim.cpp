@@ -0,0 +1,146 @@
+#include <esp_now.h>
+
+#include <cstring>
+
+espNowHostFrame espNowHostLog[ESPNOW_HOST_LOG_SIZE];
+size_t espNowHostLogCount = 0;
+
+static esp_now_peer_info_t peers[ESP_NOW_MAX_TOTAL_PEER_NUM];
+static int peerCount = 0;
+static int fetchIndex = 0;
+static esp_now_send_cb_t sendCallback = nullptr;
+static esp_now_recv_cb_t receiveCallback = nullptr;
+
+static int findPeer(const uint8_t* mac)
+{
+    for (int i = 0; i < peerCount; ++i)
+    {
+        if (memcmp(peers[i].peer_addr, mac, ESP_NOW_ETH_ALEN) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void logFrame(const uint8_t* mac, const uint8_t* data, size_t length)
+{
+    espNowHostFrame& frame = espNowHostLog[espNowHostLogCount++ % ESPNOW_HOST_LOG_SIZE];
+    memcpy(frame.mac, mac, ESP_NOW_ETH_ALEN);
+    frame.length = (uint8_t)length;
+    memcpy(frame.data, data, length);
+}
+
+esp_err_t esp_now_init()
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t callback)
+{
+    sendCallback = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t callback)
+{
+    receiveCallback = callback;
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t* mac)
+{
+    return findPeer(mac) >= 0;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t* peer)
+{
+    if (findPeer(peer->peer_addr) >= 0)
+    {
+        return ESP_ERR_ESPNOW_EXIST;
+    }
+    if (peerCount == ESP_NOW_MAX_TOTAL_PEER_NUM)
+    {
+        return ESP_ERR_ESPNOW_FULL;
+    }
+    peers[peerCount++] = *peer;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t* mac)
+{
+    int index = findPeer(mac);
+    if (index < 0)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    peers[index] = peers[--peerCount];
+    return ESP_OK;
+}
+
+esp_err_t esp_now_fetch_peer(bool fromHead, esp_now_peer_info_t* peer)
+{
+    if (fromHead)
+    {
+        fetchIndex = 0;
+    }
+    // like ESP-IDF, only unicast peers are returned, broadcast and multicast ones are skipped
+    while (fetchIndex < peerCount && (peers[fetchIndex].peer_addr[0] & 0x01) != 0)
+    {
+        ++fetchIndex;
+    }
+    if (fetchIndex >= peerCount)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    *peer = peers[fetchIndex++];
+    return ESP_OK;
+}
+
+esp_err_t esp_now_send(const uint8_t* mac, const uint8_t* data, size_t length)
+{
+    if (length == 0 || length > ESP_NOW_MAX_DATA_LEN)
+    {
+        return ESP_ERR_ESPNOW_ARG;
+    }
+    if (mac == nullptr)
+    {
+        // NULL sends to every peer in the peer list, each gets its own send callback
+        for (int i = 0; i < peerCount; ++i)
+        {
+            logFrame(peers[i].peer_addr, data, length);
+            if (sendCallback != nullptr)
+            {
+                sendCallback(peers[i].peer_addr, ESP_NOW_SEND_SUCCESS);
+            }
+        }
+        return ESP_OK;
+    }
+    if (findPeer(mac) < 0)
+    {
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+    }
+    logFrame(mac, data, length);
+    if (sendCallback != nullptr)
+    {
+        sendCallback(mac, ESP_NOW_SEND_SUCCESS);
+    }
+    return ESP_OK;
+}
+
+void espNowHostReset()
+{
+    peerCount = 0;
+    fetchIndex = 0;
+    espNowHostLogCount = 0;
+    sendCallback = nullptr;
+    receiveCallback = nullptr;
+}
+
+void espNowHostReceive(const uint8_t* mac, const uint8_t* data, int length)
+{
+    if (receiveCallback != nullptr)
+    {
+        receiveCallback(mac, data, length);
+    }
+}
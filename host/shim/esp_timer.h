@@ -0,0 +1,9 @@
+#ifndef SFDF_HOST_ESP_TIMER_H
+#define SFDF_HOST_ESP_TIMER_H
+
+#include <cstdint>
+
+// microseconds since start, monotonic like on the ESP32
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef SFDF_HOST_ESP_WIFI_H
+#define SFDF_HOST_ESP_WIFI_H
+
+typedef enum { WIFI_IF_STA = 0, WIFI_IF_AP = 1 } wifi_interface_t;
+typedef enum { WIFI_SECOND_CHAN_NONE = 0 } wifi_second_chan_t;
+
+inline int esp_wifi_set_channel(uint8_t, wifi_second_chan_t)
+{
+    return 0;
+}
+
+#endif
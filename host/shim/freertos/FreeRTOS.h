@@ -0,0 +1,37 @@
+/* Host build stand-in for the FreeRTOS types the SFDF libraries use, backed by std::thread primitives */
+
+#ifndef SFDF_HOST_FREERTOS_H
+#define SFDF_HOST_FREERTOS_H
+
+#include <cstdint>
+#include <mutex>
+
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7fffffff
+
+// spinlock on the ESP32, a plain mutex here
+struct portMUX_TYPE
+{
+    std::mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+
+inline BaseType_t xPortGetCoreID()
+{
+    return 0;
+}
+
+#endif
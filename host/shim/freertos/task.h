@@ -0,0 +1,19 @@
+#ifndef SFDF_HOST_FREERTOS_TASK_H
+#define SFDF_HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+#include <thread>
+
+// tasks are std::threads, notifications a counter with a condition variable
+BaseType_t xTaskCreate(void (*function)(void*), const char* name, uint32_t stackSize, void* param, UBaseType_t priority, TaskHandle_t* handle);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void xTaskNotifyGive(TaskHandle_t handle);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+void vTaskDelay(TickType_t ticks);
+// only a task deleting itself (nullptr) is supported
+void vTaskDelete(TaskHandle_t handle);
+
+#define taskYIELD() std::this_thread::yield()
+
+#endif
@@ -0,0 +1,124 @@
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**!
+ * @brief One FreeRTOS task, threads not made with xTaskCreate() all share the main task
+ */
+struct hostTask
+{
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifications = 0;
+    void (*function)(void*) = nullptr;
+    void* param = nullptr;
+};
+
+// thrown by vTaskDelete() to end the thread of the calling task
+struct hostTaskDeleted
+{
+};
+
+static hostTask mainTask;
+static thread_local hostTask* currentTask = nullptr;
+
+BaseType_t xTaskCreate(void (*function)(void*), const char*, uint32_t, void* param, UBaseType_t, TaskHandle_t* handle)
+{
+    // tasks never return on the ESP32, so the task and its thread are never cleaned up here either
+    hostTask* task = new hostTask;
+    task->function = function;
+    task->param = param;
+    std::thread([task]()
+    {
+        currentTask = task;
+        try
+        {
+            task->function(task->param);
+        }
+        catch (hostTaskDeleted&)
+        {
+        }
+    }).detach();
+    if (handle != nullptr)
+    {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return currentTask != nullptr ? currentTask : &mainTask;
+}
+
+void xTaskNotifyGive(TaskHandle_t handle)
+{
+    hostTask* task = (hostTask*)handle;
+    {
+        std::lock_guard<std::mutex> guard(task->lock);
+        ++task->notifications;
+    }
+    task->wake.notify_one();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+    hostTask* task = (hostTask*)xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> guard(task->lock);
+    auto notified = [task]() { return task->notifications > 0; };
+    if (ticksToWait == portMAX_DELAY)
+    {
+        task->wake.wait(guard, notified);
+    }
+    else
+    {
+        task->wake.wait_for(guard, std::chrono::milliseconds(ticksToWait), notified);
+    }
+    uint32_t count = task->notifications;
+    task->notifications = clearOnExit ? 0 : (count > 0 ? count - 1 : 0);
+    return count;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == nullptr || handle == currentTask)
+    {
+        throw hostTaskDeleted();
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex()
+{
+    return new std::recursive_timed_mutex;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    std::recursive_timed_mutex* mutex = (std::recursive_timed_mutex*)semaphore;
+    if (ticksToWait == portMAX_DELAY)
+    {
+        mutex->lock();
+        return pdTRUE;
+    }
+    if (ticksToWait == 0)
+    {
+        return mutex->try_lock() ? pdTRUE : pdFALSE;
+    }
+    return mutex->try_lock_for(std::chrono::milliseconds(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore)
+{
+    ((std::recursive_timed_mutex*)semaphore)->unlock();
+    return pdTRUE;
+}
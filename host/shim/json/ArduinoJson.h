@@ -0,0 +1,229 @@
+/* Host build stand-in for the slice of ArduinoJson 6 the SFDF libraries use: objects of numbers, strings and
+   serialized() raw values written with serializeJson(doc, buffer, size). Storage is fixed, nothing is allocated.
+   Only used when a real ArduinoJson isn't found, see host/CMakeLists.txt. */
+
+#ifndef SFDF_HOST_ARDUINOJSON_H
+#define SFDF_HOST_ARDUINOJSON_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <type_traits>
+
+#define JSON_HOST_MAX_NODES 24
+#define JSON_HOST_VALUE_LEN 32
+
+template <typename T>
+struct SerializedValue
+{
+    T value;
+};
+
+template <typename T>
+SerializedValue<T> serialized(T value)
+{
+    return SerializedValue<T>{value};
+}
+
+class JsonDocument;
+
+/**!
+ * @brief Member of an object, assigning to it stores the value
+ */
+class JsonVariant
+{
+    private:
+        JsonDocument* doc;
+        int index;
+
+    public:
+        JsonVariant(JsonDocument* doc, int index): doc(doc), index(index) {}
+        JsonVariant& operator=(const char* value);
+        JsonVariant& operator=(SerializedValue<const char*> value);
+        template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+        JsonVariant& operator=(T value);
+};
+
+/**!
+ * @brief Object inside a document, members are added on first use of operator[]
+ */
+class JsonObject
+{
+    private:
+        JsonDocument* doc;
+        int index;
+
+    public:
+        JsonObject(JsonDocument* doc, int index): doc(doc), index(index) {}
+        JsonVariant operator[](const char* key);
+        JsonObject createNestedObject(const char* key);
+};
+
+class JsonDocument
+{
+    friend class JsonVariant;
+    friend class JsonObject;
+
+    private:
+        enum nodeKind { NODE_NULL, NODE_OBJECT, NODE_STRING, NODE_RAW };
+        struct node
+        {
+            const char* key;
+            int parent;
+            nodeKind kind;
+            char value[JSON_HOST_VALUE_LEN];
+        };
+
+        // node 0 is the root object, children keep insertion order
+        node nodes[JSON_HOST_MAX_NODES];
+        int count = 1;
+
+        int member(int parent, const char* key)
+        {
+            for (int i = 1; i < count; ++i)
+            {
+                if (nodes[i].parent == parent && strcmp(nodes[i].key, key) == 0)
+                {
+                    return i;
+                }
+            }
+            if (count == JSON_HOST_MAX_NODES)
+            {
+                return -1;
+            }
+            nodes[count].key = key;
+            nodes[count].parent = parent;
+            nodes[count].kind = NODE_NULL;
+            nodes[count].value[0] = '\0';
+            return count++;
+        }
+
+        void set(int index, nodeKind kind, const char* value)
+        {
+            if (index >= 0)
+            {
+                nodes[index].kind = kind;
+                snprintf(nodes[index].value, sizeof(nodes[index].value), "%s", value);
+            }
+        }
+
+        size_t write(char* buffer, size_t size, size_t at, const char* text) const
+        {
+            for (; *text != '\0'; ++text, ++at)
+            {
+                if (at + 1 < size)
+                {
+                    buffer[at] = *text;
+                }
+            }
+            return at;
+        }
+
+        size_t writeNode(char* buffer, size_t size, size_t at, int index) const
+        {
+            const node& n = nodes[index];
+            if (n.kind == NODE_STRING)
+            {
+                at = write(buffer, size, at, "\"");
+                at = write(buffer, size, at, n.value);
+                return write(buffer, size, at, "\"");
+            }
+            if (n.kind == NODE_RAW)
+            {
+                return write(buffer, size, at, n.value);
+            }
+            if (n.kind == NODE_NULL)
+            {
+                return write(buffer, size, at, "null");
+            }
+            at = write(buffer, size, at, "{");
+            bool first = true;
+            for (int i = index + 1; i < count; ++i)
+            {
+                if (nodes[i].parent != index)
+                {
+                    continue;
+                }
+                at = write(buffer, size, at, first ? "\"" : ",\"");
+                at = write(buffer, size, at, nodes[i].key);
+                at = write(buffer, size, at, "\":");
+                at = writeNode(buffer, size, at, i);
+                first = false;
+            }
+            return write(buffer, size, at, "}");
+        }
+
+    public:
+        JsonDocument() { nodes[0].kind = NODE_OBJECT; nodes[0].parent = -1; nodes[0].key = ""; }
+
+        JsonVariant operator[](const char* key) { return JsonVariant(this, member(0, key)); }
+        JsonObject createNestedObject(const char* key) { return JsonObject(this, 0).createNestedObject(key); }
+
+        size_t serialize(char* buffer, size_t size) const
+        {
+            size_t length = writeNode(buffer, size, 0, 0);
+            if (size > 0)
+            {
+                buffer[min(length, size - 1)] = '\0';
+            }
+            return min(length, size > 0 ? size - 1 : 0);
+        }
+
+    private:
+        static size_t min(size_t a, size_t b) { return a < b ? a : b; }
+};
+
+template <size_t capacity>
+class StaticJsonDocument : public JsonDocument
+{
+};
+
+inline JsonVariant& JsonVariant::operator=(const char* value)
+{
+    doc->set(index, JsonDocument::NODE_STRING, value);
+    return *this;
+}
+
+inline JsonVariant& JsonVariant::operator=(SerializedValue<const char*> value)
+{
+    doc->set(index, JsonDocument::NODE_RAW, value.value);
+    return *this;
+}
+
+template <typename T, typename>
+JsonVariant& JsonVariant::operator=(T value)
+{
+    char text[JSON_HOST_VALUE_LEN];
+    if (std::is_floating_point<T>::value)
+    {
+        snprintf(text, sizeof(text), "%.9g", (double)value);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "%lld", (long long)value);
+    }
+    doc->set(index, JsonDocument::NODE_RAW, text);
+    return *this;
+}
+
+inline JsonVariant JsonObject::operator[](const char* key)
+{
+    return JsonVariant(doc, index < 0 ? -1 : doc->member(index, key));
+}
+
+inline JsonObject JsonObject::createNestedObject(const char* key)
+{
+    int child = index < 0 ? -1 : doc->member(index, key);
+    if (child >= 0)
+    {
+        doc->nodes[child].kind = JsonDocument::NODE_OBJECT;
+    }
+    return JsonObject(doc, child);
+}
+
+inline size_t serializeJson(const JsonDocument& doc, char* buffer, size_t size)
+{
+    return doc.serialize(buffer, size);
+}
+
+#endif
@@ -0,0 +1,17 @@
+// Host entry point for sketches, runs setup() once, loop() only as often as SFDF_HOST_LOOPS asks
+#ifndef SFDF_HOST_LOOPS
+#define SFDF_HOST_LOOPS 0
+#endif
+
+void setup();
+void loop();
+
+int main()
+{
+    setup();
+    for (int i = 0; i < SFDF_HOST_LOOPS; ++i)
+    {
+        loop();
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+/* Minimal checks for the host tests, each test is its own executable and ctest only looks at the exit code */
+
+#ifndef SFDF_HOST_TEST_H
+#define SFDF_HOST_TEST_H
+
+#include <cstdio>
+
+static int hostTestFailures = 0;
+
+// Records a failure and carries on, so one run shows every broken check
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++hostTestFailures; \
+        } \
+    } while (0)
+
+// Like CHECK() but prints both values when they differ
+#define CHECK_EQ(actual, expected) \
+    do \
+    { \
+        long long actualValue = (long long)(actual); \
+        long long expectedValue = (long long)(expected); \
+        if (actualValue != expectedValue) \
+        { \
+            printf("%s:%d: CHECK_EQ(%s, %s) failed, %lld != %lld\n", __FILE__, __LINE__, #actual, #expected, actualValue, expectedValue); \
+            ++hostTestFailures; \
+        } \
+    } while (0)
+
+// Return value for main()
+#define TEST_RESULT() (hostTestFailures == 0 ? 0 : 1)
+
+#endif
@@ -0,0 +1,107 @@
+/* ESP32Now handler table: a frame goes to the handler whose command is exactly its first word, the rest is passed as args,
+   and commands that don't fit the table are refused when they are added */
+
+#include "hostTest.h"
+
+#include <ESP32NowLib.h>
+
+#include <string>
+
+static const uint8_t masterMac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0, 0, 1};
+
+static std::string lastCommand;
+static std::string lastArgs;
+
+void onPumpOn(const uint8_t*, const char* args)
+{
+    lastCommand = "PUMPON";
+    lastArgs = args;
+}
+
+void onPumpOnX(const uint8_t*, const char* args)
+{
+    lastCommand = "PUMPONX";
+    lastArgs = args;
+}
+
+void onOther(const uint8_t*, const char* args)
+{
+    lastCommand = "other";
+    lastArgs = args;
+}
+
+// delivers text as a frame and dispatches it, returns the command of the handler that ran, empty if none did
+static std::string deliver(ESP32Now& node, const char* text)
+{
+    lastCommand.clear();
+    lastArgs.clear();
+    espNowHostReceive(masterMac, (const uint8_t*)text, strlen(text));
+    CHECK_EQ(node.dispatch(), 1);
+    return lastCommand;
+}
+
+static void testExactFirstWord()
+{
+    espNowHostReset();
+    ESP32Now node(2);
+    node.ESPNowStartSlave("Slave 2");
+    // the shorter command is added first, a prefix match would pick it for PUMPONX
+    CHECK(node.addHandler("PUMPON", onPumpOn));
+    CHECK(node.addHandler("PUMPONX", onPumpOnX));
+
+    CHECK(deliver(node, "PUMPON") == "PUMPON");
+    CHECK(deliver(node, "PUMPONX") == "PUMPONX");
+    CHECK(deliver(node, "PUMPONX 5") == "PUMPONX");
+    CHECK(lastArgs == "5");
+    // neither a longer nor a shorter word matches
+    CHECK(deliver(node, "PUMPONXY").empty());
+    CHECK(deliver(node, "PUMPO").empty());
+}
+
+static void testArgs()
+{
+    espNowHostReset();
+    ESP32Now node(2);
+    node.ESPNowStartSlave("Slave 2");
+    CHECK(node.addHandler("PUMPON", onPumpOn));
+
+    CHECK(deliver(node, "PUMPON 30") == "PUMPON");
+    CHECK(lastArgs == "30");
+    CHECK(deliver(node, "PUMPON 30 60") == "PUMPON");
+    CHECK(lastArgs == "30 60");
+    // no args is an empty string, never null
+    CHECK(deliver(node, "PUMPON") == "PUMPON");
+    CHECK(lastArgs.empty());
+}
+
+static void testAddHandlerLimits()
+{
+    espNowHostReset();
+    ESP32Now node(2);
+    node.ESPNowStartSlave("Slave 2");
+
+    std::string longest(ESPNOW_MAX_COMMAND_LEN, 'C');
+    std::string tooLong(ESPNOW_MAX_COMMAND_LEN + 1, 'C');
+    CHECK(node.addHandler(longest.c_str(), onOther));
+    CHECK(!node.addHandler(tooLong.c_str(), onPumpOn));
+    CHECK(deliver(node, longest.c_str()) == "other");
+    // the refused command is not matched by its first ESPNOW_MAX_COMMAND_LEN characters either
+    CHECK(deliver(node, tooLong.c_str()).empty());
+
+    // table holds ESPNOW_MAX_HANDLERS, the longest one above is already in it
+    for (uint8_t i = 1; i < ESPNOW_MAX_HANDLERS; ++i)
+    {
+        char command[8];
+        snprintf(command, sizeof(command), "CMD%u", i);
+        CHECK(node.addHandler(command, onOther));
+    }
+    CHECK(!node.addHandler("PUMPON", onPumpOn));
+}
+
+int main()
+{
+    testExactFirstWord();
+    testArgs();
+    testAddHandlerLimits();
+    return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+/* End to end latency of a command from AWS, the whole chain sfdf.ino runs: the modem reports the message, processDownlink()
+   parses it, the downlink handler passes it on with sendDataAll(), the frame reaches the slave, and the slave's dispatch task
+   runs its handler. Checked with the modem idle, with a publish in progress, and with the UART event finding the modem busy
+   so unlockModem() has to read the message. */
+
+#include "hostTest.h"
+
+#include <ESP32NowLib.h>
+#include <SIM7600_AWS.h>
+#include <fakeModem.h>
+
+#include <atomic>
+#include <thread>
+
+// command has to be acted on by the slave within this long, in microseconds
+#define COMMAND_BUDGET_US 100000
+// simulated cellular round trip of the publish loop() is busy with, in ms
+#define BUSY_PUBLISH_MS 30
+#define COMMANDS_PER_CASE 20
+
+static const uint8_t masterMac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0, 0, 1};
+static const uint8_t slaveMac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0, 0, 2};
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+ESP32Now master(1);
+ESP32Now slave(2);
+
+static std::atomic<unsigned long> commandAt(0);    // micros() when the message reached the modem port
+static std::atomic<unsigned long> actedAt(0);      // micros() when the slave's handler ran
+
+// slave side, like a pump slave switching its relay
+void onPump(const uint8_t*, const char*)
+{
+    actedAt = micros();
+}
+
+// the air, every frame the master sends reaches the slave right away
+void onSent(const uint8_t* mac_addr, esp_now_send_status_t)
+{
+    const espNowHostFrame& frame = espNowHostLog[(espNowHostLogCount - 1) % ESPNOW_HOST_LOG_SIZE];
+    if (memcmp(mac_addr, slaveMac, ESP_NOW_ETH_ALEN) == 0)
+    {
+        espNowHostReceive(masterMac, frame.data, frame.length);
+    }
+}
+
+// master side, same as onAWSMessage() in sfdf.ino
+void onAWSMessage(const char* topic, const char* payload)
+{
+    if (strstr(payload, "response") != NULL && strstr(payload, "PUMPON") != NULL)
+    {
+        master.sendDataAll("PUMPON");
+    }
+}
+
+static const char commandUrc[] = "+CMQTTRXSTART: 0,21,21\r\n+CMQTTRXTOPIC: 0,21\r\nsfdf/client01/command\r\n"
+                                 "+CMQTTRXPAYLOAD: 0,21\r\n{\"response\":\"PUMPON\"}\r\n+CMQTTRXEND: 0\r\n";
+
+// waits for the slave to act, returns latency in us, or COMMAND_BUDGET_US * 10 if it never did
+static unsigned long waitActed()
+{
+    for (int i = 0; i < 1000 && actedAt == 0; ++i)
+    {
+        delay(1);
+    }
+    return actedAt != 0 ? actedAt - commandAt : COMMAND_BUDGET_US * 10;
+}
+
+static void reset()
+{
+    modem.setReply("");
+    modem.publishDelay = 0;
+    modem.onPublish = nullptr;
+    modem.afterPublish = nullptr;
+    commandAt = 0;
+    actedAt = 0;
+}
+
+static void testIdle()
+{
+    // the UART event task runs processDownlink() as soon as the bytes arrive
+    unsigned long worst = 0;
+    for (int i = 0; i < COMMANDS_PER_CASE; ++i)
+    {
+        reset();
+        std::thread uartEvent([]()
+        {
+            commandAt = micros();
+            modem.appendReply(commandUrc);
+            aws.processDownlink();
+        });
+        uartEvent.join();
+        worst = max(worst, waitActed());
+    }
+    printf("idle: worst %lu us\n", worst);
+    CHECK(worst < COMMAND_BUDGET_US);
+}
+
+void arriveDuringPublish()
+{
+    commandAt = micros();
+    modem.appendReply(commandUrc);
+}
+
+static void testDuringPublish()
+{
+    // message arrives while loop() waits for a publish result, the publish reads it and runs the handler
+    unsigned long worst = 0;
+    for (int i = 0; i < COMMANDS_PER_CASE; ++i)
+    {
+        reset();
+        modem.publishDelay = BUSY_PUBLISH_MS;
+        modem.onPublish = arriveDuringPublish;
+        CHECK(aws.sendDataAWS("sfdf/client01/sensor_data", "{\"pH\":7.01}"));
+        worst = max(worst, waitActed());
+    }
+    printf("during publish: worst %lu us\n", worst);
+    CHECK(worst < COMMAND_BUDGET_US);
+}
+
+void busyUartEvent()
+{
+    // the message comes in behind the publish result, the UART event fires while loop() still has the modem and gives up
+    commandAt = micros();
+    std::thread uartEvent([]() { CHECK_EQ(aws.processDownlink(), 0); });
+    uartEvent.join();
+}
+
+static void testModemBusy()
+{
+    // counted from the start of the publish, so the time loop() keeps the modem is included
+    unsigned long worst = 0;
+    for (int i = 0; i < COMMANDS_PER_CASE; ++i)
+    {
+        reset();
+        modem.publishDelay = BUSY_PUBLISH_MS;
+        modem.onPublish = busyUartEvent;
+        modem.afterPublish = commandUrc;
+        CHECK(aws.sendDataAWS("sfdf/client01/sensor_data", "{\"pH\":7.01}"));
+        worst = max(worst, waitActed());
+        CHECK_EQ(modem.available(), 0);
+    }
+    printf("modem busy: worst %lu us\n", worst);
+    CHECK(worst < COMMAND_BUDGET_US);
+}
+
+int main()
+{
+    espNowHostReset();
+    WiFi.hostAddNetwork("Slave 1", slaveMac, -40);
+
+    slave.ESPNowStartSlave("Slave 1");
+    CHECK(slave.addHandler("PUMPON", onPump));
+    CHECK(slave.startDispatchTask());
+
+    master.ESPNowStartMaster(onSent);
+    CHECK(master.addPeer("Slave 1"));
+
+    aws.setDownlinkHandler(onAWSMessage);
+    testIdle();
+    testDuringPublish();
+    testModemBusy();
+    return TEST_RESULT();
+}
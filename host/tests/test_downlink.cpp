@@ -0,0 +1,112 @@
+/* Downlink URC parsing against the fake modem: a message from AWS arriving in the middle of a publish reply must not be
+   taken for the reply, and a processDownlink() that finds the port busy must not leave the message unread */
+
+#include "hostTest.h"
+
+#include <SIM7600_AWS.h>
+#include <fakeModem.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+
+std::vector<std::string> received;     // "<topic> <payload>" of every message handled
+
+void onDownlink(const char* topic, const char* payload)
+{
+    received.push_back(std::string(topic) + " " + payload);
+}
+
+// URC sequence of one message from AWS, payload may contain anything
+static std::string urcOf(const char* topic, const char* payload)
+{
+    char text[256];
+    snprintf(text, sizeof(text), "+CMQTTRXSTART: 0,%u,%u\r\n+CMQTTRXTOPIC: 0,%u\r\n%s\r\n+CMQTTRXPAYLOAD: 0,%u\r\n%s\r\n+CMQTTRXEND: 0\r\n",
+             (unsigned)strlen(topic), (unsigned)strlen(payload), (unsigned)strlen(topic), topic, (unsigned)strlen(payload), payload);
+    return text;
+}
+
+static std::string injected;
+
+void injectDuringPublish()
+{
+    modem.appendReply(injected.c_str());
+}
+
+static void reset()
+{
+    modem.setReply("");
+    modem.failPublishes = 0;
+    modem.onPublish = nullptr;
+    modem.afterPublish = nullptr;
+    received.clear();
+}
+
+static void testPayloadLooksLikeSuccess()
+{
+    // publish fails, but a command arriving meanwhile carries the success text in its payload
+    reset();
+    injected = urcOf("sfdf/client01/command", "+CMQTTPUB: 0,0\r\nOK\r\n>");
+    modem.onPublish = injectDuringPublish;
+    modem.failPublishes = 1;
+    CHECK(!aws.sendDataAWS("sfdf/client01/sensor_data", "{\"pH\":7.01}"));
+    CHECK_EQ(received.size(), 1);
+    CHECK(received.size() == 1 && received[0] == "sfdf/client01/command +CMQTTPUB: 0,0\r\nOK\r\n>");
+}
+
+static void testPayloadLooksLikeError()
+{
+    // publish goes through, the command's payload says ERROR
+    reset();
+    injected = urcOf("sfdf/client01/command", "ERROR");
+    modem.onPublish = injectDuringPublish;
+    CHECK(aws.sendDataAWS("sfdf/client01/sensor_data", "{\"pH\":7.01}"));
+    CHECK_EQ(received.size(), 1);
+    CHECK(received.size() == 1 && received[0] == "sfdf/client01/command ERROR");
+}
+
+static int busyResult = -1;
+
+void processFromOtherTask()
+{
+    // like the UART event task while loop() is publishing
+    std::thread event([]() { busyResult = aws.processDownlink(); });
+    event.join();
+}
+
+static void testBusyProcessDownlink()
+{
+    // the message arrives after the publish read its result, the UART event found the port busy and gave up
+    reset();
+    std::string late = urcOf("sfdf/client01/command", "PUMPON");
+    modem.afterPublish = late.c_str();
+    modem.onPublish = processFromOtherTask;
+    CHECK(aws.sendDataAWS("sfdf/client01/sensor_data", "{\"pH\":7.01}"));
+    CHECK_EQ(busyResult, 0);
+    // read when the publish let go of the port, not left for a UART event that may never come
+    CHECK_EQ(received.size(), 1);
+    CHECK(received.size() == 1 && received[0] == "sfdf/client01/command PUMPON");
+    CHECK_EQ(modem.available(), 0);
+}
+
+static void testIdleProcessDownlink()
+{
+    reset();
+    modem.appendReply(urcOf("sfdf/client01/command", "PUMPOFF").c_str());
+    CHECK_EQ(aws.processDownlink(), 1);
+    CHECK(received.size() == 1 && received[0] == "sfdf/client01/command PUMPOFF");
+}
+
+int main()
+{
+    aws.setDownlinkHandler(onDownlink);
+    testPayloadLooksLikeSuccess();
+    testPayloadLooksLikeError();
+    testBusyProcessDownlink();
+    testIdleProcessDownlink();
+    return TEST_RESULT();
+}
@@ -0,0 +1,43 @@
+/* The publish path of SIM7600AWS must not touch the heap, counted with the host allocation interposer */
+
+#include "hostTest.h"
+
+#include <allocCounter.h>
+#include <fakeModem.h>
+#include <SIM7600_AWS.h>
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+
+static void publishCycle()
+{
+    fixedValue ph = {712, 2, true};
+    fixedValue ec = {850, 0, true};
+    fixedValue do_data = {6200, 3, true};
+    fixedValue temperature = {2315, 2, true};
+    aws.sendSensorData("sfdf/client01/sensor_data", ph, ec, do_data, temperature);
+    aws.sendSensorData("sfdf/client01/sensor_data", 7.12, 850.0, 6.2, 23.15);
+    CHECK(aws.sendDataAWS("sfdf/client01/alarm", "{\"node\":0,\"alarm\":\"low_DO\",\"DO\":3.100}"));
+    CHECK(aws.queueDataAWS("sfdf/client01/ack", "{\"ack\":\"PUMPON\"}", UPLINK_COMMAND_ACK));
+    CHECK_EQ(aws.processUplink(), 1);
+}
+
+int main()
+{
+    // first cycle outside the count, static set up on first use is not the publish path
+    publishCycle();
+
+    const int cycles = 10;
+    allocCounter::start();
+    for (int i = 0; i < cycles; ++i)
+    {
+        publishCycle();
+    }
+    allocCounter::stop();
+
+    printf("%ld allocations, %ld bytes in %d publish cycles\n", allocCounter::count(), allocCounter::bytes(), cycles);
+    CHECK_EQ(allocCounter::count(), 0);
+    CHECK_EQ(allocCounter::bytes(), 0);
+    return TEST_RESULT();
+}
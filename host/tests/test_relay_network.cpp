@@ -0,0 +1,337 @@
+/* Relay mode on a simulated multi-node network: route choice, learning from duplicates, and delivery ratio and latency
+   by hop count over lossy links. Each simulated node runs the real relayRouter, only the radio is simulated. */
+
+#include "hostTest.h"
+
+#include <ESP32NowLib.h>
+
+#include <cmath>
+#include <queue>
+#include <random>
+#include <vector>
+
+static void macOf(uint8_t node, uint8_t* mac)
+{
+    const uint8_t base[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0x00, 0x00, 0x00};
+    memcpy(mac, base, ESP_NOW_ETH_ALEN);
+    mac[5] = node;
+}
+
+static relayHeader header(uint8_t origin, uint8_t dest, uint8_t hops, uint16_t seq)
+{
+    relayHeader h = {RELAY_MAGIC, origin, dest, uint8_t(RELAY_DEFAULT_TTL - hops), hops, seq};
+    return h;
+}
+
+/* route choice and learning, checked on a single router */
+
+static void routeChoice()
+{
+    uint8_t gateway[ESP_NOW_ETH_ALEN], relay[ESP_NOW_ETH_ALEN];
+    macOf(0, gateway);
+    macOf(1, relay);
+
+    relayRouter router;
+    router.begin(2);
+    router.updateNeighbor(gateway, -90);
+    router.updateNeighbor(relay, -30);
+
+    // a barely reachable direct link loses to two hops over a strong first link
+    relayHeader direct = header(0, 2, 0, 1);
+    CHECK_EQ(router.receive(direct, gateway, 0), RELAY_DELIVER);
+    CHECK(memcmp(router.nextHop(0, 0), gateway, ESP_NOW_ETH_ALEN) == 0);
+    relayHeader relayed = header(0, 2, 1, 2);
+    router.receive(relayed, relay, 0);
+    CHECK(memcmp(router.nextHop(0, 0), relay, ESP_NOW_ETH_ALEN) == 0);
+
+    // and a strong direct link beats the same two hops
+    router.begin(2);
+    router.updateNeighbor(gateway, -60);
+    router.updateNeighbor(relay, -30);
+    relayed = header(0, 2, 1, 1);
+    router.receive(relayed, relay, 0);
+    direct = header(0, 2, 0, 2);
+    router.receive(direct, gateway, 0);
+    CHECK(memcmp(router.nextHop(0, 0), gateway, ESP_NOW_ETH_ALEN) == 0);
+
+    // a flood reaches us over the weak direct link first, the later duplicate over the better path still fixes the route
+    router.begin(2);
+    router.updateNeighbor(gateway, -90);
+    router.updateNeighbor(relay, -30);
+    relayHeader first = header(0, RELAY_BROADCAST, 0, 7);
+    CHECK_EQ(router.receive(first, gateway, 0), RELAY_FORWARD | RELAY_DELIVER);
+    relayHeader copy = header(0, RELAY_BROADCAST, 1, 7);
+    CHECK_EQ(router.receive(copy, relay, 0), 0);
+    CHECK(memcmp(router.nextHop(0, 0), relay, ESP_NOW_ETH_ALEN) == 0);
+
+    // frames for others are forwarded with one hop more and one TTL less, never past the TTL
+    relayHeader through = header(5, 0, 1, 9);
+    CHECK_EQ(router.receive(through, relay, 0), RELAY_FORWARD);
+    CHECK_EQ(through.hops, 2);
+    CHECK_EQ(through.ttl, RELAY_DEFAULT_TTL - 2);
+    relayHeader last = header(5, 0, RELAY_DEFAULT_TTL - 1, 10);
+    CHECK_EQ(router.receive(last, relay, 0), 0);
+
+    // own frames flooded back are ignored
+    relayHeader own = header(2, RELAY_BROADCAST, 1, 3);
+    CHECK_EQ(router.receive(own, relay, 0), 0);
+}
+
+/* sendDataAll with relay mode on must not also send to the broadcast peer */
+
+void onSent(const uint8_t*, esp_now_send_status_t) {}
+
+static void sendAllSkipsBroadcast()
+{
+    espNowHostReset();
+    WiFi.hostClearNetworks();
+    uint8_t slaveMac[ESP_NOW_ETH_ALEN];
+    macOf(9, slaveMac);
+    WiFi.hostAddNetwork("Slave 1", slaveMac, -50);
+
+    ESP32Now node(1);
+    node.ESPNowStartMaster(onSent);
+    node.enableRelay(0);
+    CHECK(node.addPeer("Slave 1"));
+
+    espNowHostLogCount = 0;
+    node.sendDataAll("PUMPON");
+    CHECK_EQ(espNowHostLogCount, 1);
+    CHECK(memcmp(espNowHostLog[0].mac, slaveMac, ESP_NOW_ETH_ALEN) == 0);
+}
+
+/* network simulation */
+
+// simulated time for a frame on air plus the receiver's queue and dispatch, per hop, in microseconds
+#define SIM_AIRTIME_US 1200
+#define SIM_DISPATCH_US 800
+// ESP-Now unicast is acknowledged and retried by the MAC, broadcast is sent once
+#define SIM_UNICAST_ATTEMPTS 3
+#define SIM_NODES_PER_BRANCH 4
+#define SIM_SPACING_M 60.0
+#define SIM_ROUNDS 150
+
+struct simNode
+{
+    relayRouter router;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    double x;
+    double y;
+    uint8_t hopsFromGateway;
+};
+
+struct simEvent
+{
+    int64_t time;
+    uint8_t to;
+    uint8_t from;
+    relayHeader header;
+    int64_t sentAt;
+    bool operator>(const simEvent& other) const { return time > other.time; }
+};
+
+struct hopStats
+{
+    uint32_t sent = 0;
+    uint32_t delivered = 0;
+    int64_t latencySum = 0;
+};
+
+class simNetwork
+{
+    public:
+        std::vector<simNode> nodes;
+        std::priority_queue<simEvent, std::vector<simEvent>, std::greater<simEvent>> events;
+        std::mt19937 random;
+        int64_t now = 0;
+        hopStats commands[SIM_NODES_PER_BRANCH + 1];
+        hopStats acks[SIM_NODES_PER_BRANCH + 1];
+
+        explicit simNetwork(uint32_t seed): random(seed)
+        {
+            // gateway in the middle of two lines of nodes, each one hop further out, with some sideways scatter
+            std::uniform_real_distribution<double> scatter(-10.0, 10.0);
+            nodes.resize(1 + 2 * SIM_NODES_PER_BRANCH);
+            for (size_t i = 0; i < nodes.size(); ++i)
+            {
+                simNode& node = nodes[i];
+                uint8_t step = (i + 1) / 2;
+                double direction = i % 2 == 1 ? 1.0 : -1.0;
+                node.x = i == 0 ? 0.0 : direction * step * SIM_SPACING_M;
+                node.y = i == 0 ? 0.0 : scatter(random);
+                node.hopsFromGateway = step;
+                node.router.begin(i);
+                macOf(i, node.mac);
+            }
+
+            // what scanNeighbors() would find
+            for (size_t i = 0; i < nodes.size(); ++i)
+            {
+                for (size_t j = 0; j < nodes.size(); ++j)
+                {
+                    if (i != j && inRange(i, j))
+                    {
+                        nodes[i].router.updateNeighbor(nodes[j].mac, (int8_t)rssi(i, j));
+                    }
+                }
+            }
+        }
+
+        // -30 dBm up close, 0.5 dB weaker per metre, so 60 m is a good link and 120 m a poor one
+        double rssi(size_t a, size_t b)
+        {
+            double distance = std::hypot(nodes[a].x - nodes[b].x, nodes[a].y - nodes[b].y);
+            return -30.0 - 0.5 * distance;
+        }
+
+        bool inRange(size_t a, size_t b)
+        {
+            return rssi(a, b) > -100.0;
+        }
+
+        // chance a single transmission is lost, from 2% on good links up to 90% near the edge of range
+        double lossRate(size_t a, size_t b)
+        {
+            return std::min(0.9, std::max(0.02, (-rssi(a, b) - 60.0) / 40.0));
+        }
+
+        // number of transmissions until one got through, 0 if all attempts were lost
+        int attemptsNeeded(size_t a, size_t b, int attempts)
+        {
+            std::uniform_real_distribution<double> chance(0.0, 1.0);
+            for (int i = 1; i <= attempts; ++i)
+            {
+                if (chance(random) >= lossRate(a, b))
+                {
+                    return i;
+                }
+            }
+            return 0;
+        }
+
+        // what ESP32Now::sendRelayFrame() does, next hop if there is a route else broadcast
+        void transmit(uint8_t from, const relayHeader& header, int64_t sentAt)
+        {
+            const uint8_t* next = nodes[from].router.nextHop(header.dest, now / 1000);
+            for (size_t to = 0; to < nodes.size(); ++to)
+            {
+                if (to == from || !inRange(from, to))
+                {
+                    continue;
+                }
+                if (next != nullptr && memcmp(next, nodes[to].mac, ESP_NOW_ETH_ALEN) != 0)
+                {
+                    continue;
+                }
+                int attempts = attemptsNeeded(from, to, next != nullptr ? SIM_UNICAST_ATTEMPTS : 1);
+                if (attempts > 0)
+                {
+                    events.push({now + attempts * SIM_AIRTIME_US + SIM_DISPATCH_US, (uint8_t)to, from, header, sentAt});
+                }
+            }
+        }
+
+        // what ESP32Now::relaySend() does
+        void send(uint8_t from, uint8_t dest)
+        {
+            relayRouter& router = nodes[from].router;
+            relayHeader header = {RELAY_MAGIC, from, dest, RELAY_DEFAULT_TTL, 0, router.nextSeq()};
+            router.isDuplicate(from, header.seq);
+            transmit(from, header, now);
+        }
+
+        void run()
+        {
+            while (!events.empty())
+            {
+                simEvent event = events.top();
+                events.pop();
+                now = event.time;
+
+                simNode& node = nodes[event.to];
+                uint8_t action = node.router.receive(event.header, nodes[event.from].mac, now / 1000);
+                if (action & RELAY_FORWARD)
+                {
+                    transmit(event.to, event.header, event.sentAt);
+                }
+                if ((action & RELAY_DELIVER) && event.header.dest == event.to)
+                {
+                    if (event.to == 0)
+                    {
+                        record(acks[nodes[event.header.origin].hopsFromGateway], event.sentAt);
+                    }
+                    else
+                    {
+                        record(commands[node.hopsFromGateway], event.sentAt);
+                        acks[node.hopsFromGateway].sent++;
+                        send(event.to, 0);
+                    }
+                }
+            }
+        }
+
+        void record(hopStats& stats, int64_t sentAt)
+        {
+            stats.delivered++;
+            stats.latencySum += now - sentAt;
+        }
+
+        // gateway sends a command to every node in turn, each node answers with an ack
+        void simulate()
+        {
+            for (int round = 0; round < SIM_ROUNDS; ++round)
+            {
+                for (uint8_t node = 1; node < nodes.size(); ++node)
+                {
+                    commands[nodes[node].hopsFromGateway].sent++;
+                    send(0, node);
+                    run();
+                    // next command 100 ms later, no collisions are simulated
+                    now += 100000;
+                }
+            }
+        }
+};
+
+static void networkSimulation(uint32_t seed)
+{
+    simNetwork network(seed);
+    network.simulate();
+
+    // the 2 hop nodes must be reached over the strong 60 m links, not the weak 120 m direct one
+    CHECK(memcmp(network.nodes[0].router.nextHop(3, network.now / 1000), network.nodes[1].mac, ESP_NOW_ETH_ALEN) == 0);
+    CHECK(memcmp(network.nodes[3].router.nextHop(0, network.now / 1000), network.nodes[1].mac, ESP_NOW_ETH_ALEN) == 0);
+
+    printf("seed %u\nhops,commands_sent,command_delivery,command_latency_ms,acks_sent,ack_delivery,ack_latency_ms\n", seed);
+    double lastLatency = 0;
+    for (uint8_t hops = 1; hops <= SIM_NODES_PER_BRANCH; ++hops)
+    {
+        const hopStats& command = network.commands[hops];
+        const hopStats& ack = network.acks[hops];
+        double commandRatio = double(command.delivered) / command.sent;
+        double ackRatio = ack.sent > 0 ? double(ack.delivered) / ack.sent : 0;
+        double commandLatency = command.delivered > 0 ? command.latencySum / 1000.0 / command.delivered : 0;
+        double ackLatency = ack.delivered > 0 ? ack.latencySum / 1000.0 / ack.delivered : 0;
+        printf("%u,%u,%.3f,%.2f,%u,%.3f,%.2f\n", hops, command.sent, commandRatio, commandLatency, ack.sent, ackRatio, ackLatency);
+
+        // every hop count the TTL allows gets nearly everything through, and with good links picked retries are rare,
+        // so latency grows by about one hop time per hop
+        CHECK(commandRatio >= 0.97);
+        CHECK(ackRatio >= 0.97);
+        CHECK(commandLatency > lastLatency);
+        CHECK(commandLatency <= hops * (SIM_AIRTIME_US + SIM_DISPATCH_US) / 1000.0 * 1.1);
+        CHECK(ackLatency <= hops * (SIM_AIRTIME_US + SIM_DISPATCH_US) / 1000.0 * 1.1);
+        lastLatency = commandLatency;
+    }
+}
+
+int main()
+{
+    routeChoice();
+    sendAllSkipsBroadcast();
+    for (uint32_t seed = 1; seed <= 3; ++seed)
+    {
+        networkSimulation(seed);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,120 @@
+/* Two-thread stress test of the SPSC ringBuffer that carries received ESP-Now frames from the WiFi task to dispatch */
+
+#include "hostTest.h"
+
+#include <ESP32NowLib.h>
+
+#include <atomic>
+#include <thread>
+
+/**!
+ * @brief Producer fills frames in place the way onDataRecvQueued() does, consumer checks order and contents.
+ * @param frames number of frames the producer offers
+ * @param retry true to retry a frame until it fits, so none are lost, false to drop it like the WiFi callback does
+ */
+static void stress(uint32_t frames, bool retry)
+{
+    ringBuffer<espNowFrame, ESPNOW_RX_QUEUE_SIZE> queue;
+    std::atomic<bool> producerDone(false);
+    uint32_t rejected = 0;
+    uint32_t accepted = 0;
+
+    std::thread producer([&]()
+    {
+        for (uint32_t seq = 0; seq < frames; ++seq)
+        {
+            espNowFrame* frame;
+            while ((frame = queue.writeSlot()) == nullptr)
+            {
+                ++rejected;
+                if (!retry)
+                {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            if (frame != nullptr)
+            {
+                // whole frame carries the sequence number, a torn read shows up as a mismatch
+                memcpy(frame->mac, &seq, sizeof(seq));
+                frame->length = sizeof(seq);
+                frame->rxTime = seq;
+                memset(frame->data, (uint8_t)seq, sizeof(frame->data));
+                queue.commitWrite();
+                ++accepted;
+            }
+            if (!retry)
+            {
+                // frames arrive spread out over the air, give the consumer a chance to run
+                std::this_thread::yield();
+            }
+        }
+        producerDone = true;
+    });
+
+    uint32_t received = 0;
+    uint32_t corrupt = 0;
+    uint32_t outOfOrder = 0;
+    int64_t lastSeq = -1;
+    while (true)
+    {
+        // read the flag first, anything committed before it was set is visible below
+        bool done = producerDone;
+        espNowFrame* frame = queue.readSlot();
+        if (frame == nullptr)
+        {
+            if (done)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+
+        uint32_t seq;
+        memcpy(&seq, frame->mac, sizeof(seq));
+        if (frame->rxTime != seq || frame->length != sizeof(seq) || (uint8_t)frame->data[0] != (uint8_t)seq
+            || (uint8_t)frame->data[ESP_NOW_MAX_DATA_LEN] != (uint8_t)seq)
+        {
+            ++corrupt;
+        }
+        // lossless run must see every frame in turn, lossy run only increasing numbers
+        if ((int64_t)seq <= lastSeq || (retry && (int64_t)seq != lastSeq + 1))
+        {
+            ++outOfOrder;
+        }
+        lastSeq = seq;
+        queue.commitRead();
+        ++received;
+
+        if (!retry && received % 256 == 0)
+        {
+            // consumer stalls now and then like a busy loop(), so the buffer fills and frames get dropped
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    producer.join();
+
+    printf("%s: %u accepted, %u rejected, %u dropped\n", retry ? "retry" : "drop", accepted, rejected, queue.droppedCount());
+    CHECK_EQ(corrupt, 0);
+    CHECK_EQ(outOfOrder, 0);
+    CHECK_EQ(received, accepted);
+    CHECK_EQ(queue.droppedCount(), rejected);
+    CHECK_EQ(queue.size(), 0);
+    if (retry)
+    {
+        CHECK_EQ(accepted, frames);
+    }
+    else
+    {
+        CHECK_EQ(accepted + rejected, frames);
+        CHECK(rejected > 0);
+    }
+}
+
+int main()
+{
+    stress(200000, true);
+    stress(50000, false);
+    return TEST_RESULT();
+}
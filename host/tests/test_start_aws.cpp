@@ -0,0 +1,196 @@
+/* startAWS() against a fake modem left in each state it can be in after an ESP32 reset: checks which set up commands are
+   sent, that the connection comes up, and that a negative query answer doesn't cost a reply timeout */
+
+#include "hostTest.h"
+
+#include <SIM7600_AWS.h>
+#include <fakeModem.h>
+
+// Every scenario answers at once, so anything near SIM7600_TIMEOUT_SHORT means a query waited for a reply timeout
+#define START_AWS_MAX_MS 500
+
+static const char clientName[] = "SFDF_Test";
+static const char endpoint[] = "example-ats.iot.eu-west-2.amazonaws.com";
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+
+// modem state after a successful startAWS(), what it keeps when only the ESP32 resets
+static void setUpModem()
+{
+    snprintf(modem.cacert, sizeof(modem.cacert), "cacert.pem");
+    snprintf(modem.clientcert, sizeof(modem.clientcert), "clientcert.pem");
+    snprintf(modem.clientkey, sizeof(modem.clientkey), "clientkey.pem");
+    modem.networkOpen = true;
+    modem.mqttStarted = true;
+    snprintf(modem.mqttClient, sizeof(modem.mqttClient), "%s", clientName);
+    modem.mqttConnected = true;
+}
+
+// true if what the library left unread is only the line end after the last OK, not another reply line
+static bool replyConsumed()
+{
+    int c;
+    while ((c = modem.read()) >= 0)
+    {
+        if (c != '\r' && c != '\n')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool start(unsigned long& took)
+{
+    modem.setReply("");
+    modem.clearLog();
+    unsigned long start_millis = millis();
+    bool connected = aws.startAWS(clientName, endpoint, "cacert", "clientcert", "clientkey");
+    took = millis() - start_millis;
+    return connected;
+}
+
+static void testCold()
+{
+    // modem just powered up
+    modem.cacert[0] = 0;
+    modem.clientcert[0] = 0;
+    modem.clientkey[0] = 0;
+    modem.networkOpen = false;
+    modem.mqttStarted = false;
+    modem.mqttClient[0] = 0;
+    modem.mqttConnected = false;
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    CHECK(modem.sent("AT+CSSLCFG=\"cacert\""));
+    CHECK(modem.sent("AT+NETOPEN\n"));
+    CHECK(modem.sent("AT+CMQTTSTART"));
+    CHECK(modem.sent("AT+CMQTTACCQ=0,\"SFDF_Test\""));
+    CHECK(!modem.sent("AT+CMQTTREL"));
+    CHECK(modem.sent("AT+CMQTTCONNECT"));
+    CHECK(modem.mqttConnected);
+}
+
+static void testWarm()
+{
+    setUpModem();
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    // only the connection query
+    CHECK(modem.sent("AT+CMQTTDISC?"));
+    CHECK(!modem.sent("AT+CSSLCFG"));
+    CHECK(!modem.sent("AT+NETOPEN"));
+    CHECK(!modem.sent("AT+CMQTTCONNECT"));
+    // whole reply read, nothing left for the next command to trip over
+    CHECK(replyConsumed());
+}
+
+static void testNoMqttConnection()
+{
+    // broker dropped the connection, client still acquired
+    setUpModem();
+    modem.mqttConnected = false;
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    CHECK(!modem.sent("AT+CSSLCFG=\"cacert\""));
+    CHECK(!modem.sent("AT+NETOPEN\n"));
+    CHECK(!modem.sent("AT+CMQTTSTART"));
+    CHECK(!modem.sent("AT+CMQTTACCQ=0"));
+    CHECK(modem.sent("AT+CMQTTCONNECT"));
+    CHECK(modem.mqttConnected);
+}
+
+static void testNoMqttService()
+{
+    // MQTT service stopped, query for the client answers ERROR
+    setUpModem();
+    modem.mqttStarted = false;
+    modem.mqttClient[0] = 0;
+    modem.mqttConnected = false;
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    CHECK(modem.sent("AT+CMQTTSTART"));
+    CHECK(modem.sent("AT+CMQTTACCQ=0,\"SFDF_Test\""));
+    CHECK(!modem.sent("AT+CMQTTREL"));
+    CHECK(modem.mqttConnected);
+}
+
+static void testOtherClient()
+{
+    // another sketch left its client at index 0
+    setUpModem();
+    snprintf(modem.mqttClient, sizeof(modem.mqttClient), "Other");
+    modem.mqttConnected = false;
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    CHECK(modem.sent("AT+CMQTTREL=0"));
+    CHECK(modem.sent("AT+CMQTTACCQ=0,\"SFDF_Test\""));
+    CHECK(strcmp(modem.mqttClient, clientName) == 0);
+    CHECK(modem.mqttConnected);
+}
+
+static void testNoNetwork()
+{
+    // network closed, which also drops the MQTT connection
+    setUpModem();
+    modem.networkOpen = false;
+    modem.mqttConnected = false;
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    CHECK(modem.sent("AT+NETOPEN?"));
+    CHECK(modem.sent("AT+NETOPEN\n"));
+    CHECK(!modem.sent("AT+CSSLCFG=\"cacert\""));
+    CHECK(modem.networkOpen);
+    CHECK(modem.mqttConnected);
+}
+
+static void testNoSsl()
+{
+    // modem was power cycled but kept nothing of the SSL context, eg. after a firmware update
+    setUpModem();
+    modem.clientkey[0] = 0;
+    modem.mqttConnected = false;
+    unsigned long took;
+    CHECK(start(took));
+    CHECK(took < START_AWS_MAX_MS);
+    CHECK(modem.sent("AT+CSSLCFG=\"clientkey\",0,\"clientkey.pem\""));
+    CHECK(strcmp(modem.clientkey, "clientkey.pem") == 0);
+    CHECK(modem.mqttConnected);
+}
+
+static void testIsConnected()
+{
+    // a negative answer comes back as fast as a positive one
+    setUpModem();
+    modem.mqttConnected = false;
+    modem.setReply("");
+    unsigned long start_millis = millis();
+    CHECK(!aws.isConnectedAWS());
+    CHECK(millis() - start_millis < START_AWS_MAX_MS);
+    CHECK(replyConsumed());
+
+    modem.mqttConnected = true;
+    CHECK(aws.isConnectedAWS());
+    CHECK(replyConsumed());
+}
+
+int main()
+{
+    testCold();
+    testWarm();
+    testNoMqttConnection();
+    testNoMqttService();
+    testOtherClient();
+    testNoNetwork();
+    testNoSsl();
+    testIsConnected();
+    return TEST_RESULT();
+}
@@ -0,0 +1,133 @@
+/* Streaming sendDataAWS() against the fake modem: payloads that fit, a writer that runs out early, payloads split into
+   parts, and a part that fails to publish */
+
+#include "hostTest.h"
+
+#include <SIM7600_AWS.h>
+#include <fakeModem.h>
+
+#include <string>
+#include <vector>
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+
+struct publishRecord
+{
+    std::string topic;
+    size_t length;
+    char first;     // first payload byte, tells where in the stream the part started
+};
+std::vector<publishRecord> published;
+
+void onPublish()
+{
+    published.push_back({modem.publishedTopic(), modem.publishedLength(), modem.publishedPayload()[0]});
+}
+
+// writes the byte pattern 'a' + offset % 26 and stops after limit bytes
+struct patternPayload
+{
+    size_t offset;
+    size_t limit;
+};
+
+static size_t writePattern(char* buffer, size_t size, void* context)
+{
+    patternPayload* pattern = (patternPayload*)context;
+    size_t length = min(size, pattern->limit - pattern->offset);
+    for (size_t i = 0; i < length; ++i)
+    {
+        buffer[i] = 'a' + (pattern->offset + i) % 26;
+    }
+    pattern->offset += length;
+    return length;
+}
+
+static void reset()
+{
+    modem.setReply("");
+    modem.clearLog();
+    modem.failPublishes = 0;
+    published.clear();
+}
+
+static void testSinglePart()
+{
+    reset();
+    CHECK(aws.sendDataAWS("sfdf/test", "{\"pH\":7.01}"));
+    CHECK_EQ(published.size(), 1);
+    CHECK(published[0].topic == "sfdf/test");
+    CHECK(strcmp(modem.publishedPayload(), "{\"pH\":7.01}") == 0);
+}
+
+static void testWriterShort()
+{
+    // announced 300 bytes but only 100 come
+    reset();
+    patternPayload pattern = {0, 100};
+    CHECK(!aws.sendDataAWS("sfdf/test", 300, writePattern, &pattern));
+    CHECK(modem.sent("AT+CMQTTPAYLOAD=0,300"));
+    // padding went to the modem, but nothing was published
+    CHECK(!modem.sent("AT+CMQTTPUB"));
+    CHECK_EQ(published.size(), 0);
+
+    // modem is left ready for the next message
+    CHECK(aws.sendDataAWS("sfdf/test", "next"));
+    CHECK_EQ(published.size(), 1);
+}
+
+static void testParts()
+{
+    reset();
+    size_t length = 2 * SIM7600_MAX_PAYLOAD + 100;
+    patternPayload pattern = {0, length};
+    CHECK(aws.sendDataAWS("sfdf/backlog", length, writePattern, &pattern));
+    CHECK_EQ(published.size(), 3);
+    if (published.size() == 3)
+    {
+        CHECK(published[0].topic == "sfdf/backlog/part/1/3");
+        CHECK(published[1].topic == "sfdf/backlog/part/2/3");
+        CHECK(published[2].topic == "sfdf/backlog/part/3/3");
+        CHECK_EQ(published[0].length, SIM7600_MAX_PAYLOAD);
+        CHECK_EQ(published[1].length, SIM7600_MAX_PAYLOAD);
+        CHECK_EQ(published[2].length, 100);
+        CHECK_EQ(published[1].first, 'a' + SIM7600_MAX_PAYLOAD % 26);
+        CHECK_EQ(published[2].first, 'a' + (2 * SIM7600_MAX_PAYLOAD) % 26);
+    }
+    CHECK_EQ(pattern.offset, length);
+}
+
+static void testExactlyMax()
+{
+    // one full part is still a plain publish on the topic
+    reset();
+    patternPayload pattern = {0, SIM7600_MAX_PAYLOAD};
+    CHECK(aws.sendDataAWS("sfdf/backlog", SIM7600_MAX_PAYLOAD, writePattern, &pattern));
+    CHECK_EQ(published.size(), 1);
+    CHECK(published.size() == 1 && published[0].topic == "sfdf/backlog");
+}
+
+static void testFailedPart()
+{
+    // first part fails, the other two are not sent
+    reset();
+    modem.failPublishes = 1;
+    size_t length = 2 * SIM7600_MAX_PAYLOAD + 100;
+    patternPayload pattern = {0, length};
+    CHECK(!aws.sendDataAWS("sfdf/backlog", length, writePattern, &pattern));
+    CHECK_EQ(published.size(), 1);
+    CHECK_EQ(pattern.offset, SIM7600_MAX_PAYLOAD);
+}
+
+int main()
+{
+    modem.onPublish = onPublish;
+    testSinglePart();
+    testWriterShort();
+    testParts();
+    testExactlyMax();
+    testFailedPart();
+    return TEST_RESULT();
+}
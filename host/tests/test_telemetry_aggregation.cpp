@@ -0,0 +1,271 @@
+/* Telemetry aggregation path with simulated sensor nodes: TLM frames arrive over relay mode, the master's ESP32Now
+   dispatches them to the aggregator, and sendTelemetryBatch publishes them through the fake modem. Also runs the dispatch
+   task against a loop() that publishes, the way sfdf.ino does. */
+
+#include "hostTest.h"
+
+#include <ESP32NowLib.h>
+#include <SFDFTelemetry.h>
+#include <SIM7600_AWS.h>
+#include <fakeModem.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define SIM_READINGS_PER_NODE 4
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+ESP32Now master(1);
+telemetryAggregator telemetry;
+std::vector<std::string> published;
+
+void onSent(const uint8_t*, esp_now_send_status_t) {}
+
+// same handler as sfdf.ino
+void onTelemetry(const uint8_t* mac_addr, const char* args)
+{
+    uint8_t nodeId;
+    sensorReading reading;
+    if (decodeTelemetry(args, nodeId, reading))
+    {
+        telemetry.add(nodeId, reading);
+    }
+}
+
+void onPublish()
+{
+    published.push_back(modem.publishedPayload());
+}
+
+// node n, k-th reading, chosen so averages are easy to predict: pH 7.00 + n/100 + 3/100, DO rounds half away from zero
+static sensorReading readingOf(uint8_t node, uint8_t k)
+{
+    sensorReading reading = {{int32_t(700 + node + 2 * k), 2, true}, {int32_t(800 + 10 * node), 0, true},
+                             {int32_t(6000 + k), 3, true}, {int32_t(2300 + node), 2, true}};
+    if (node == 7)
+    {
+        // node 7 has a broken EC probe
+        reading.ec.valid = false;
+    }
+    return reading;
+}
+
+static std::string expectedNode(uint8_t node)
+{
+    char text[128];
+    char ec[16];
+    snprintf(ec, sizeof(ec), node == 7 ? "null" : "%d", 800 + 10 * node);
+    snprintf(text, sizeof(text), "{\"node\":%u,\"pH\":%d.%02d,\"EC\":%s,\"DO\":6.002,\"Temp\":%d.%02d}",
+             node, (703 + node) / 100, (703 + node) % 100, ec, (2300 + node) / 100, (2300 + node) % 100);
+    return text;
+}
+
+// one slave sends a reading as a relay frame to node 0, like sensor_slave.ino does with relaySend(0, frame)
+static void receiveReading(uint8_t node, const sensorReading& reading)
+{
+    static uint16_t seq = 0;
+    uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+    relayHeader header = {RELAY_MAGIC, node, 0, RELAY_DEFAULT_TTL, 0, ++seq};
+    memcpy(frame, &header, sizeof(header));
+    size_t length = encodeTelemetry((char*)frame + sizeof(header), sizeof(frame) - sizeof(header), node, reading);
+    CHECK(length > 0);
+
+    uint8_t mac[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0x00, 0x00, node};
+    espNowHostReceive(mac, frame, sizeof(header) + length);
+}
+
+// every slave samples on the same synced tick, so each round the whole burst is queued before the master dispatches once
+static void simulateNodes()
+{
+    for (uint8_t k = 0; k < SIM_READINGS_PER_NODE; ++k)
+    {
+        telemetry.add(0, readingOf(0, k));
+        for (uint8_t node = 1; node < TELEMETRY_MAX_NODES; ++node)
+        {
+            receiveReading(node, readingOf(node, k));
+        }
+        CHECK_EQ(master.dispatch(), TELEMETRY_MAX_NODES - 1);
+    }
+    CHECK_EQ(master.droppedFrames(), 0);
+}
+
+static void testFullBurst()
+{
+    // a frame from every slave at once, plus a copy of each relayed by a neighbor, still fits before a single dispatch()
+    uint32_t before = master.droppedFrames();
+    for (uint8_t node = 1; node <= TELEMETRY_MAX_NODES; ++node)
+    {
+        uint8_t frame[ESP_NOW_MAX_DATA_LEN];
+        relayHeader header = {RELAY_MAGIC, node, 0, RELAY_DEFAULT_TTL, 0, 1000};
+        memcpy(frame, &header, sizeof(header));
+        size_t length = encodeTelemetry((char*)frame + sizeof(header), sizeof(frame) - sizeof(header), node, readingOf(node, 0));
+        uint8_t mac[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0x00, 0x00, node};
+        uint8_t neighbor[ESP_NOW_ETH_ALEN] = {0x24, 0x6f, 0x28, 0x00, 0x01, node};
+        espNowHostReceive(mac, frame, sizeof(header) + length);
+        espNowHostReceive(neighbor, frame, sizeof(header) + length);
+    }
+    CHECK_EQ(master.dispatch(), 2 * TELEMETRY_MAX_NODES);
+    CHECK_EQ(master.droppedFrames() - before, 0);
+
+    // leave the aggregator empty for the next test
+    char message[SIM7600_BATCH_BUFFER_SIZE];
+    while (telemetry.buildBatch(message, sizeof(message), "") > 0)
+    {
+        telemetry.commitBatch();
+    }
+}
+
+static void testAddedWhilePublishing()
+{
+    // a reading that arrives between buildBatch() and commitBatch() goes out with the next batch, nothing is lost
+    telemetryAggregator aggregator;
+    char message[SIM7600_BATCH_BUFFER_SIZE];
+    sensorReading first = {{700, 2, true}, {800, 0, true}, {6000, 3, true}, {2300, 2, true}};
+    sensorReading second = {{720, 2, true}, {820, 0, true}, {6100, 3, true}, {2400, 2, true}};
+    aggregator.add(3, first);
+    CHECK(aggregator.buildBatch(message, sizeof(message), "") > 0);
+    CHECK(strstr(message, "\"pH\":7.00,") != NULL);
+    aggregator.add(3, second);
+    aggregator.commitBatch();
+
+    CHECK_EQ(aggregator.pendingNodes(), 1);
+    CHECK(aggregator.buildBatch(message, sizeof(message), "") > 0);
+    CHECK(strstr(message, "{\"node\":3,\"pH\":7.20,\"EC\":820,\"DO\":6.100,\"Temp\":24.00}") != NULL);
+    aggregator.commitBatch();
+    CHECK_EQ(aggregator.pendingNodes(), 0);
+}
+
+/* dispatch task against a publishing loop() */
+
+#define SIM_THREADED_ROUNDS 2000
+
+static void testDispatchTask()
+{
+    // every node always sends the same reading, so any published average other than that reading means a torn update
+    published.clear();
+    std::atomic<bool> done(false);
+    master.startDispatchTask();
+    std::thread loopTask([&]()
+    {
+        while (!done)
+        {
+            aws.sendTelemetryBatch("sfdf/client01/site_data", telemetry);
+        }
+    });
+    for (int round = 0; round < SIM_THREADED_ROUNDS; ++round)
+    {
+        for (uint8_t node = 1; node < TELEMETRY_MAX_NODES; ++node)
+        {
+            receiveReading(node, readingOf(node, 1));
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    // let the dispatch task finish the last burst
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    done = true;
+    loopTask.join();
+    aws.sendTelemetryBatch("sfdf/client01/site_data", telemetry);
+    CHECK_EQ(telemetry.pendingNodes(), 0);
+    CHECK_EQ(master.droppedFrames(), 0);
+
+    size_t nodesSeen = 0;
+    for (const std::string& message : published)
+    {
+        for (uint8_t node = 1; node < TELEMETRY_MAX_NODES; ++node)
+        {
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "{\"node\":%u,", node);
+            size_t at = message.find(prefix);
+            if (at != std::string::npos)
+            {
+                char expected[128];
+                snprintf(expected, sizeof(expected), "{\"node\":%u,\"pH\":%d.%02d,", node, (702 + node) / 100, (702 + node) % 100);
+                CHECK(message.compare(at, strlen(expected), expected) == 0);
+                ++nodesSeen;
+            }
+        }
+    }
+    printf("threaded: %zu batch messages, %zu node entries\n", published.size(), nodesSeen);
+    CHECK(nodesSeen >= TELEMETRY_MAX_NODES - 1);
+}
+
+// every node shows up exactly once over all published messages, with the right averages
+static void checkPublished()
+{
+    std::string all;
+    for (const std::string& message : published)
+    {
+        CHECK(message.compare(0, 13, "{\"DateTime\":\"") == 0);
+        CHECK(message.size() < SIM7600_BATCH_BUFFER_SIZE);
+        all += message;
+    }
+    for (uint8_t node = 0; node < TELEMETRY_MAX_NODES; ++node)
+    {
+        std::string object = expectedNode(node);
+        size_t first = all.find(object);
+        CHECK(first != std::string::npos);
+        CHECK(first == std::string::npos || all.find(object, first + 1) == std::string::npos);
+        if (first == std::string::npos)
+        {
+            printf("missing %s\n", object.c_str());
+        }
+    }
+}
+
+int main()
+{
+    master.ESPNowStartMaster(onSent);
+    master.enableRelay(0);
+    master.addHandler(TELEMETRY_COMMAND, onTelemetry);
+    modem.onPublish = onPublish;
+
+    simulateNodes();
+    CHECK_EQ(telemetry.pendingNodes(), TELEMETRY_MAX_NODES);
+    int messages = aws.sendTelemetryBatch("sfdf/client01/site_data", telemetry);
+    CHECK(messages > 0);
+    CHECK_EQ((int)published.size(), messages);
+    CHECK_EQ(telemetry.pendingNodes(), 0);
+    checkPublished();
+
+    // a failed publish is neither counted nor retried in a loop, and every reading is kept
+    published.clear();
+    simulateNodes();
+    modem.failPublishes = 1;
+    uint32_t before = modem.publishes;
+    CHECK_EQ(aws.sendTelemetryBatch("sfdf/client01/site_data", telemetry), 0);
+    CHECK_EQ(modem.publishes - before, 0);
+    CHECK_EQ(telemetry.pendingNodes(), TELEMETRY_MAX_NODES);
+
+    // and goes out with the next call, averages unchanged because the kept sums weren't touched
+    published.clear();
+    CHECK_EQ(aws.sendTelemetryBatch("sfdf/client01/site_data", telemetry), messages);
+    CHECK_EQ(telemetry.pendingNodes(), 0);
+    checkPublished();
+
+    // split over several small messages, a batch that isn't committed is built again the same way
+    published.clear();
+    simulateNodes();
+    char message[400];
+    size_t length;
+    while ((length = telemetry.buildBatch(message, sizeof(message), "23/04/14,12:42:16")) > 0)
+    {
+        CHECK(length < sizeof(message));
+        std::string first(message, length);
+        CHECK_EQ(telemetry.buildBatch(message, sizeof(message), "23/04/14,12:42:16"), length);
+        CHECK(first == std::string(message, length));
+        telemetry.commitBatch();
+        published.push_back(first);
+    }
+    CHECK(published.size() > 1);
+    CHECK_EQ(telemetry.pendingNodes(), 0);
+    checkPublished();
+
+    testFullBurst();
+    testAddedWhilePublishing();
+    testDispatchTask();
+    return TEST_RESULT();
+}
@@ -0,0 +1,217 @@
+/* timeSync against simulated beacons: a drifting slave clock, lost beacons and beacons held up in the WiFi task, plus a master
+   reboot. Also checks that slaves without time sync drop beacons instead of passing them to the command handlers, and that
+   loop() reading the estimate while the dispatch task adds beacons never sees half of an update. */
+
+#include "hostTest.h"
+
+#include <ESP32NowLib.h>
+
+#include <atomic>
+#include <random>
+#include <thread>
+
+#define SIM_DRIFT_PPM 80
+#define SIM_LOSS 0.2
+#define SIM_LATE 0.1
+#define SIM_LATE_US 30000
+// air time plus receive callback, the same for every slave so it isn't counted as error
+#define SIM_AIR_US 400
+#define SIM_JITTER_US 200
+#define SIM_BEACONS 600
+// beacons before the error is checked, the first ones may be late or lost
+#define SIM_WARMUP 20
+#define SIM_MAX_ERROR_US 10000
+// the window is only TIMESYNC_WINDOW beacons, so jitter leaves the drift estimate this far off
+#define SIM_DRIFT_TOLERANCE_PPM 20
+
+struct slaveClock
+{
+    int64_t start;
+    double drift;
+
+    // slave clock at the moment the master clock shows master
+    int64_t at(double master) { return start + int64_t(master * (1 + drift)); }
+};
+
+// runs one slave over SIM_BEACONS beacons a second apart, returns the largest error of the master time estimate
+static int64_t simulate(unsigned seed, int64_t masterStart, timeSync& sync, slaveClock& clock)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::uniform_int_distribution<int> jitter(0, SIM_JITTER_US);
+    int64_t worst = 0;
+
+    for (int k = 0; k < SIM_BEACONS; ++k)
+    {
+        int64_t master = masterStart + int64_t(k) * 1000000;
+        if (chance(rng) >= SIM_LOSS)
+        {
+            int64_t delay = SIM_AIR_US + jitter(rng) + (chance(rng) < SIM_LATE ? SIM_LATE_US : 0);
+            sync.addBeacon(master, clock.at(master + delay));
+        }
+        if (k >= SIM_WARMUP)
+        {
+            // check halfway to the next beacon, where the drift estimate matters most
+            int64_t check = master + 500000;
+            int64_t error = sync.toMaster(clock.at(check)) - check;
+            error = error < 0 ? -error : error;
+            worst = max(worst, error);
+        }
+    }
+    return worst;
+}
+
+static void testDriftLossAndLateBeacons()
+{
+    for (unsigned seed = 1; seed <= 8; ++seed)
+    {
+        timeSync sync;
+        slaveClock clock = {int64_t(seed) * 3000000, (seed % 2 ? 1 : -1) * SIM_DRIFT_PPM * 1e-6};
+        int64_t worst = simulate(seed, 0, sync, clock);
+        printf("seed %u: max error %lld us, drift %.1f ppm\n", seed, (long long)worst, sync.driftPpm());
+        CHECK(worst < SIM_MAX_ERROR_US);
+        // driftPpm() is the slope of master - local, negative for a slave clock running fast
+        float drift = (seed % 2 ? -1 : 1) * SIM_DRIFT_PPM;
+        CHECK(sync.driftPpm() > drift - SIM_DRIFT_TOLERANCE_PPM && sync.driftPpm() < drift + SIM_DRIFT_TOLERANCE_PPM);
+    }
+}
+
+static void testLateRunKeepsEstimate()
+{
+    // a run of late beacons just short of TIMESYNC_MAX_OUTLIERS doesn't move the estimate
+    timeSync sync;
+    slaveClock clock = {5000000, SIM_DRIFT_PPM * 1e-6};
+    int64_t master = 0;
+    for (int k = 0; k < 10; ++k, master += 1000000)
+    {
+        CHECK(sync.addBeacon(master, clock.at(master + SIM_AIR_US)));
+    }
+    for (int k = 0; k < TIMESYNC_MAX_OUTLIERS - 1; ++k, master += 1000000)
+    {
+        CHECK(!sync.addBeacon(master, clock.at(master + SIM_AIR_US + SIM_LATE_US)));
+    }
+    int64_t error = sync.toMaster(clock.at(master)) - master;
+    CHECK(error > -1000 && error < 1000);
+    CHECK(sync.addBeacon(master, clock.at(master + SIM_AIR_US)));
+}
+
+static void testMasterReboot()
+{
+    timeSync sync;
+    slaveClock clock = {5000000, -SIM_DRIFT_PPM * 1e-6};
+    simulate(11, 0, sync, clock);
+
+    // master rebooted, its clock starts over while the slave's keeps running
+    slaveClock rebooted = {clock.at(SIM_BEACONS * 1000000.0), clock.drift};
+    int64_t worst = simulate(12, 0, sync, rebooted);
+    printf("after reboot: max error %lld us\n", (long long)worst);
+    CHECK(worst < SIM_MAX_ERROR_US);
+}
+
+static void testOffsetOnlyAtStart()
+{
+    // two beacons with different delays would suggest a large drift, it isn't fitted yet
+    timeSync sync;
+    sync.addBeacon(0, 1000000);
+    sync.addBeacon(1000000, 2001000);
+    CHECK(sync.synced());
+    CHECK(sync.driftPpm() == 0);
+    int64_t error = sync.toMaster(2500500) - 1500000;
+    CHECK(error > -1000 && error < 1000);
+}
+
+/* one task adding beacons, another converting times */
+
+#define SIM_THREADED_BEACONS 300000
+// a large drift so every refit moves the reference offset by SIM_THREADED_DRIFT_PPM us, and a mixed up estimate shows
+#define SIM_THREADED_DRIFT_PPM 1000
+#define SIM_THREADED_OFFSET 123456789
+
+static void testConcurrentReaders()
+{
+    // master = local * (1 + drift) + offset exactly, so every estimate fitted from a full window is exact anywhere on the line
+    timeSync sync;
+    auto masterAt = [](int64_t local) { return local + local / 1000000 * SIM_THREADED_DRIFT_PPM + SIM_THREADED_OFFSET; };
+    int64_t local = 0;
+    for (int k = 0; k < TIMESYNC_WINDOW; ++k, local += 1000000)
+    {
+        sync.addBeacon(masterAt(local), local);
+    }
+
+    std::atomic<bool> done(false);
+    std::thread dispatchTask([&]()
+    {
+        int64_t time = local;
+        for (int k = 0; k < SIM_THREADED_BEACONS; ++k, time += 1000000)
+        {
+            sync.addBeacon(masterAt(time), time);
+        }
+        done = true;
+    });
+
+    uint32_t reads = 0;
+    uint32_t wrong = 0;
+    while (!done)
+    {
+        // a point on the grid of whole seconds, the conversion there is exact
+        int64_t check = int64_t(reads % 1000) * 1000000;
+        int64_t error = sync.toMaster(check) - masterAt(check);
+        int64_t back = sync.toLocal(masterAt(check)) - check;
+        if (error < -2 || error > 2 || back < -2 || back > 2)
+        {
+            ++wrong;
+        }
+        ++reads;
+    }
+    dispatchTask.join();
+    printf("concurrent: %u reads, %u wrong\n", reads, wrong);
+    CHECK(reads > 0);
+    CHECK_EQ(wrong, 0);
+}
+
+/* dispatch */
+
+static int syncHandlerCalls = 0;
+
+void onSyncCommand(const uint8_t*, const char*)
+{
+    ++syncHandlerCalls;
+}
+
+static void testDispatch()
+{
+    static const uint8_t masterMac[ESP_NOW_ETH_ALEN] = {0x24, 0x0a, 0xc4, 0, 0, 1};
+    const char beacon[] = TIMESYNC_COMMAND " 1000000";
+
+    // without time sync beacons are dropped, not reported as unknown commands
+    espNowHostReset();
+    ESP32Now plain(2);
+    plain.ESPNowStartSlave("Slave 2");
+    plain.addHandler(TIMESYNC_COMMAND, onSyncCommand);
+    espNowHostReceive(masterMac, (const uint8_t*)beacon, sizeof(beacon) - 1);
+    CHECK_EQ(plain.dispatch(), 1);
+    CHECK_EQ(syncHandlerCalls, 0);
+    CHECK(!plain.syncedClock().synced());
+
+    espNowHostReset();
+    ESP32Now synced(3);
+    synced.ESPNowStartSlave("Slave 3");
+    synced.enableTimeSync();
+    // both arrive at once here, so the second one carries nearly the same master time
+    const char next[] = TIMESYNC_COMMAND " 1000050";
+    espNowHostReceive(masterMac, (const uint8_t*)beacon, sizeof(beacon) - 1);
+    espNowHostReceive(masterMac, (const uint8_t*)next, sizeof(next) - 1);
+    CHECK_EQ(synced.dispatch(), 2);
+    CHECK(synced.syncedClock().synced());
+}
+
+int main()
+{
+    testDriftLossAndLateBeacons();
+    testLateRunKeepsEstimate();
+    testMasterReboot();
+    testOffsetOnlyAtStart();
+    testConcurrentReaders();
+    testDispatch();
+    return TEST_RESULT();
+}
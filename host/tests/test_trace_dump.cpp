@@ -0,0 +1,118 @@
+/* Trace ring dump after the ring wrapped: end events whose begin was overwritten are left out, every scope in the dump is
+   whole per task, and the streamed dump is exactly as long as beginDump() said */
+
+#include "hostTest.h"
+
+#include <SFDFTrace.h>
+
+#include <map>
+#include <string>
+
+// the dispatch task of the test, records one scope whenever notified
+static TaskHandle_t otherTask = nullptr;
+
+void otherTaskMain(void*)
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        SFDF_TRACE_SCOPE("other_scope");
+    }
+}
+
+static std::string dumpAll()
+{
+    size_t expected = Trace.beginDump();
+    std::string json;
+    char buffer[40];
+    size_t length;
+    while ((length = sfdfTrace::writeDump(buffer, sizeof(buffer), &Trace)) > 0)
+    {
+        json.append(buffer, length);
+    }
+    Trace.endDump();
+    CHECK_EQ(json.size(), expected);
+    return json;
+}
+
+// scope depth per tid never goes below zero, returns number of events
+static size_t checkNesting(const std::string& json)
+{
+    std::map<std::string, int> depth;
+    size_t events = 0;
+    size_t at = 0;
+    while ((at = json.find("\"ph\":\"", at)) != std::string::npos)
+    {
+        char phase = json[at + 6];
+        size_t tid = json.find("\"tid\":", at);
+        std::string task = json.substr(tid + 6, json.find_first_of(",}", tid) - tid - 6);
+        if (phase == 'B')
+        {
+            ++depth[task];
+        }
+        else if (phase == 'E')
+        {
+            CHECK(depth[task] > 0);
+            --depth[task];
+        }
+        ++events;
+        at = tid;
+    }
+    return events;
+}
+
+static void testWrapped()
+{
+    xTaskCreate(otherTaskMain, "other", 4096, nullptr, 1, &otherTask);
+
+    // an outer scope and a long run of inner ones, the outer begin event is overwritten long before it ends
+    Trace.record("outer", 'B');
+    Trace.record("middle", 'B');
+    for (int i = 0; i < 2 * TRACE_BUFFER_SIZE; ++i)
+    {
+        SFDF_TRACE_SCOPE("inner");
+        if (i % 50 == 0)
+        {
+            xTaskNotifyGive(otherTask);
+        }
+    }
+    vTaskDelay(20);
+    Trace.record("middle", 'E');
+    Trace.record("outer", 'E');
+
+    std::string json = dumpAll();
+    CHECK(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+    CHECK(json.compare(json.size() - 2, 2, "]}") == 0);
+    // no comma in front of the first event even though events before it were left out
+    CHECK(json.compare(16, 2, "{\"") == 0);
+    CHECK(json.find("\"outer\"") == std::string::npos);
+    CHECK(json.find("\"middle\"") == std::string::npos);
+    CHECK(json.find("\"other_scope\"") != std::string::npos);
+    // only the two stray ends are left out
+    CHECK_EQ(checkNesting(json), TRACE_BUFFER_SIZE - 2);
+}
+
+static void testStrayEndBeforeWrap()
+{
+    // a scope still open while recording was paused for a dump ends without a begin in the ring, it is left out too
+    sfdfTrace* fresh = new sfdfTrace;
+    fresh->record("stray", 'E');
+    fresh->record("scope", 'B');
+    fresh->record("scope", 'E');
+    size_t expected = fresh->beginDump();
+    char buffer[TRACE_BUFFER_SIZE * TRACE_EVENT_JSON_LEN];
+    size_t length = sfdfTrace::writeDump(buffer, sizeof(buffer), fresh);
+    fresh->endDump();
+    CHECK_EQ(length, expected);
+    std::string json(buffer, length);
+    CHECK(json.find("\"stray\"") == std::string::npos);
+    CHECK(json.find("\"scope\"") != std::string::npos);
+    delete fresh;
+}
+
+int main()
+{
+    testWrapped();
+    testStrayEndBeforeWrap();
+    return TEST_RESULT();
+}
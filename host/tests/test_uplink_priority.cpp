@@ -0,0 +1,211 @@
+/* Uplink priority lanes against the fake modem: an alarm raised while a backlog goes out is published right after the message
+   already on its way, bulk still gets a turn after SIM7600_BULK_STARVATION_LIMIT higher priority sends, and messages queued
+   from several tasks at once while loop() sends come out whole */
+
+#include "hostTest.h"
+
+#include <SIM7600_AWS.h>
+#include <SFDFTelemetry.h>
+#include <fakeModem.h>
+
+#include <atomic>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// simulated time the modem takes per publish, in ms
+#define UPLINK_PUBLISH_MS 50
+// scheduling slack on top of the publishes an alarm may wait for, in ms
+#define UPLINK_SLACK_MS 25
+
+static const char alarmTopic[] = "sfdf/client01/alarm";
+static const char bulkTopic[] = "sfdf/client01/sensor_data";
+static const char bulkMessage[] = "{\"data\":{\"pH\":7.12,\"EC\":850,\"DO\":6.200,\"Temp\":23.15}}";
+
+fakeModem modem;
+nullPrint quiet;
+SIM7600AWS aws(&modem, &quiet);
+telemetryAggregator backlog;
+
+std::vector<std::string> topics;    // topic of every publish, in order
+std::vector<size_t> raisedAt;       // number of publishes done when each alarm was queued
+
+// publish numbers (1 based) during which an alarm is raised, like one queued from another task
+static const size_t alarmDuring[] = {1, 3, 6};
+
+void onBacklogPublish()
+{
+    topics.push_back(modem.publishedTopic());
+    for (size_t during : alarmDuring)
+    {
+        if (topics.size() == during)
+        {
+            raisedAt.push_back(topics.size());
+            aws.queueDataAWS(alarmTopic, "{\"node\":0,\"alarm\":\"low_DO\",\"DO\":3.100}", UPLINK_ALARM);
+        }
+    }
+}
+
+static void testAlarmDuringBacklog()
+{
+    // full bulk lane plus a telemetry flush of every node
+    sensorReading reading = {{712, 2, true}, {850, 0, true}, {6200, 3, true}, {2315, 2, true}};
+    for (uint8_t i = 0; i < SIM7600_UPLINK_QUEUE_SIZE; ++i)
+    {
+        CHECK(aws.queueDataAWS(bulkTopic, bulkMessage, UPLINK_BULK));
+    }
+    for (uint8_t node = 0; node < TELEMETRY_MAX_NODES; ++node)
+    {
+        backlog.add(node, reading);
+    }
+
+    topics.clear();
+    raisedAt.clear();
+    modem.publishDelay = UPLINK_PUBLISH_MS;
+    modem.onPublish = onBacklogPublish;
+    aws.processUplink();
+    aws.sendTelemetryBatch("sfdf/client01/site_data", backlog);
+    aws.processUplink();
+    modem.publishDelay = 0;
+    modem.onPublish = nullptr;
+
+    // each alarm is the very next publish after the one it was raised during
+    CHECK_EQ(raisedAt.size(), sizeof(alarmDuring) / sizeof(alarmDuring[0]));
+    size_t alarms = 0;
+    for (size_t i = 0; i < topics.size(); ++i)
+    {
+        if (topics[i] == alarmTopic)
+        {
+            CHECK(alarms < raisedAt.size() && i == raisedAt[alarms]);
+            ++alarms;
+        }
+    }
+    CHECK_EQ(alarms, raisedAt.size());
+    CHECK(aws.maxUplinkLatency(UPLINK_ALARM) <= 2 * UPLINK_PUBLISH_MS + UPLINK_SLACK_MS);
+    CHECK_EQ(aws.pendingUplink(UPLINK_BULK), 0);
+}
+
+/* anti-starvation */
+
+// alarms still to raise, one per publish so the alarm lane never runs empty
+static int alarmsLeft = 0;
+
+void onBusyPublish()
+{
+    topics.push_back(modem.publishedTopic());
+    if (alarmsLeft > 0)
+    {
+        --alarmsLeft;
+        aws.queueDataAWS(alarmTopic, "{\"alarm\":\"flood\"}", UPLINK_ALARM);
+    }
+}
+
+static void testBulkNotStarved()
+{
+    topics.clear();
+    CHECK(aws.queueDataAWS(bulkTopic, bulkMessage, UPLINK_BULK));
+    CHECK(aws.queueDataAWS(bulkTopic, bulkMessage, UPLINK_BULK));
+    for (uint8_t i = 0; i < SIM7600_UPLINK_QUEUE_SIZE; ++i)
+    {
+        CHECK(aws.queueDataAWS(alarmTopic, "{\"alarm\":\"flood\"}", UPLINK_ALARM));
+    }
+    alarmsLeft = 3 * SIM7600_BULK_STARVATION_LIMIT;
+    modem.onPublish = onBusyPublish;
+    aws.processUplink();
+    modem.onPublish = nullptr;
+
+    // alarms never ran out, still each bulk message went after SIM7600_BULK_STARVATION_LIMIT of them
+    std::vector<size_t> bulkAt;
+    for (size_t i = 0; i < topics.size(); ++i)
+    {
+        if (topics[i] == bulkTopic)
+        {
+            bulkAt.push_back(i);
+        }
+    }
+    CHECK_EQ(bulkAt.size(), 2);
+    if (bulkAt.size() == 2)
+    {
+        CHECK_EQ(bulkAt[0], SIM7600_BULK_STARVATION_LIMIT);
+        CHECK_EQ(bulkAt[1], 2 * SIM7600_BULK_STARVATION_LIMIT + 1);
+    }
+    CHECK_EQ(aws.pendingUplink(UPLINK_ALARM), 0);
+}
+
+/* several producers */
+
+#define SIM_PRODUCERS 3
+#define SIM_MESSAGES_PER_PRODUCER 500
+
+std::vector<std::string> payloads;
+
+void onProducerPublish()
+{
+    topics.push_back(modem.publishedTopic());
+    payloads.push_back(modem.publishedPayload());
+}
+
+static void testProducers()
+{
+    // like the dispatch task, the UART event task and loop() all raising alarms, each message carries its producer and number
+    topics.clear();
+    payloads.clear();
+    modem.onPublish = onProducerPublish;
+    std::atomic<int> running(SIM_PRODUCERS);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < SIM_PRODUCERS; ++p)
+    {
+        producers.emplace_back([&, p]()
+        {
+            for (int k = 0; k < SIM_MESSAGES_PER_PRODUCER; ++k)
+            {
+                char message[SIM7600_UPLINK_MSG_LEN];
+                snprintf(message, sizeof(message), "{\"producer\":%d,\"k\":%d,\"pad\":\"%0150d\"}", p, k, k);
+                while (!aws.queueDataAWS(alarmTopic, message, UPLINK_ALARM))
+                {
+                    std::this_thread::yield();
+                }
+            }
+            --running;
+        });
+    }
+    while (running > 0 || aws.pendingUplink(UPLINK_ALARM) > 0)
+    {
+        aws.processUplink();
+    }
+    for (std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    modem.onPublish = nullptr;
+
+    // every message exactly once, none torn, each producer's in its own order
+    CHECK_EQ(payloads.size(), SIM_PRODUCERS * SIM_MESSAGES_PER_PRODUCER);
+    std::set<std::string> seen;
+    int last[SIM_PRODUCERS] = {-1, -1, -1};
+    for (const std::string& payload : payloads)
+    {
+        int p = -1, k = -1;
+        CHECK(sscanf(payload.c_str(), "{\"producer\":%d,\"k\":%d,", &p, &k) == 2);
+        if (p < 0 || p >= SIM_PRODUCERS)
+        {
+            continue;
+        }
+        char expected[SIM7600_UPLINK_MSG_LEN];
+        snprintf(expected, sizeof(expected), "{\"producer\":%d,\"k\":%d,\"pad\":\"%0150d\"}", p, k, k);
+        CHECK(payload == expected);
+        CHECK(k > last[p]);
+        last[p] = k;
+        seen.insert(payload);
+    }
+    CHECK_EQ(seen.size(), payloads.size());
+}
+
+int main()
+{
+    testAlarmDuringBacklog();
+    testBulkNotStarved();
+    testProducers();
+    return TEST_RESULT();
+}
@@ -15,6 +15,7 @@ Uses mix of own custom libraries and some other custom libraries like ArduinoJso
 #include <ESP32NowLib.h>
 #include <SFDFSensor.h>
 #include "SIM7600_AWS.h"
+#include <SFDFTrace.h>
 
 
 // Serial 2 uses pin 16 (U2RX) and 17 (U2TX) on ESP32 Dev C Wroom, for this example for AWS
@@ -45,10 +46,42 @@ ESP32Now espNode(1);
 // bools to check connection status of each slave
 bool connectionStatus1;
 
+// id of this node for ESP-Now relay mode, sensor slaves send their readings to node 0
+#define NODE_ID 0
+
+// readings from this node and every sensor slave, published together every send_interval
+telemetryAggregator telemetry;
+
 // millis variable for sending data every x seconds without using delay
 unsigned long pervious_sent_millis = 0;
 const long send_interval = 30000;  // interval to send data to AWS, in milliseconds
 
+// millis variable for sending ESP-Now time beacons, so sensor slaves sample on the same clock
+unsigned long previous_beacon_millis = 0;
+const long beacon_interval = 1000;
+
+// frames from the sensor slaves lost to a full ESP-Now receive queue, last count printed
+uint32_t reported_dropped_frames = 0;
+
+// dissolved oxygen below this raises an alarm, raw value with 3 decimals like readDOFixed() (4.000 mg/L)
+const int32_t do_alarm_level = 4000;
+
+// latency of commands from AWS, from the modem reporting the message until the slave's WiFi acknowledged the ESP-Now frame,
+// in microseconds. It stops at the MAC ack, the slave's dispatch and handler come after it (host/tests/test_command_latency.cpp
+// times the whole chain up to the slave's handler)
+volatile unsigned long command_rx_micros = 0;       // set when a command is received, cleared once it is delivered
+volatile unsigned long command_latency_micros = 0;  // latest delivered command, cleared once printed
+unsigned long max_command_latency_micros = 0;
+
+// loop iterations longer than this are flagged by the trace profiler and the trace is dumped to Serial, in milliseconds
+// a send_interval round (sensor reads, two publishes and the peer scan) normally takes a few seconds, so only real stalls go over
+const uint32_t loop_budget = 10000;
+
+// a dump blocks the loop for over a second at 115200 baud, so dump at most once this often, in milliseconds
+unsigned long previous_dump_millis = 0;
+bool trace_dumped = false;
+const long dump_interval = 600000;
+
 void setup() 
 {
 
@@ -57,23 +90,32 @@ void setup()
     Serial.begin(115200);
     Serial.println("ESP32 + SIM7600 -> AWS Example.");
 
+    // start stall profiler, library calls record where loop() spends its time
+    Trace.begin(loop_budget);
+
     // Start serial port to SIM7600 with RXD2 and TXD2
     Serial2.begin (115200, SERIAL_8N1, RXD2, TXD2);
 
-    aws.disconnectAWS();
-    delay(1000);
-    
-    // make sure you configured the module beforehand and pass the correct matching file names
-    aws.configureSSL("cacert","clientcert","clientkey");
-    delay(1000);
-
+    // only sets up what the SIM7600 doesn't already have, so after an ESP32 reset with the modem still connected this is quick
     // first parameter can be whatever name you desire, second parameter replace with your own endpoint
-    aws.connectAWS("client01", "a5sswhj5ru4gy-ats.iot.us-east-2.amazonaws.com");
-    delay(1000);
+    // make sure you configured the module beforehand and pass the correct matching certificate file names
+    aws.startAWS("client01", "a5sswhj5ru4gy-ats.iot.us-east-2.amazonaws.com", "cacert","clientcert","clientkey");
 
     // subscribe to topic, replace with your own if you like
     aws.subscribeTopic("sfdf/client01/command");
 
+    /**
+      Example of receiving message from AWS and based on message relay command to another ESP32 via ESP-Now.
+
+      Every byte from the SIM7600 goes through a parser in the library that picks out received MQTT messages. Serial2 calls onModemReceive
+      as soon as bytes arrive, in its own event task, so a command is handled even while loop() is busy (eg. reading sensors or scanning WiFi).
+      If loop() is in the middle of a publish, the library reads the bytes itself and calls the handler from there.
+      Example of the published AWS message is {response: "PUMPON"}. Once it receives AWS message with either "PUMPON" or "PUMPOFF", onAWSMessage
+      will activate function sendESPNow.
+     */
+    aws.setDownlinkHandler(onAWSMessage);
+    Serial2.onReceive(onModemReceive);
+
     // Start serial 1
     Serial1.begin(9600, SERIAL_8N1, RXD1, TXD1);
     delay(1000);
@@ -88,10 +130,31 @@ void setup()
     // Connect to another ESP32 with ESP-Now that is set to slave mode
     connectionStatus1 = espNode.addPeer("Slave 1"); // copy this line with different name for more peers
 
+    // Receive readings from sensor slaves (see SFDFSensorLib sensor_slave example). They all arrive on the same synced tick,
+    // so they are handled in the dispatch task as they come instead of waiting in the queue while loop() publishes.
+    // Priority 2 is above loop() and below the WiFi task.
+    espNode.enableRelay(NODE_ID);
+    espNode.addHandler(TELEMETRY_COMMAND, onTelemetry);
+    espNode.startDispatchTask(4096, 2);
+
+    // first sensor round and publish run on the first loop() instead of send_interval after boot
+    pervious_sent_millis = millis() - send_interval;
 }
 
 void loop() 
 {
+    Trace.loopBegin();
+
+    // time beacon for the sensor slaves
+    if (millis() - previous_beacon_millis >= beacon_interval)
+    {
+        previous_beacon_millis = millis();
+        espNode.sendTimeBeacon();
+    }
+
+    // publish queued alarms and command acks (and bulk messages if any) in priority order
+    aws.processUplink();
+
     // Timer for sending sensor data every send_interval seconds
     unsigned long current_millis = millis();
     if (current_millis - pervious_sent_millis >= send_interval) 
@@ -99,41 +162,100 @@ void loop()
         // update previous_sent_millis tracker
         pervious_sent_millis = current_millis;
         
-        // example of sending some sensor datas
-        double ph = nodes.readPh();
-        double ec = nodes.readEC();
-        double do_data = nodes.readDO();
-        double temperature = nodes.readTemperature();
+        // example of sending some sensor datas, read as fixed-point (raw register value + decimals) so no double math on the ESP32
+        fixedValue ph = nodes.readPhFixed();
+        fixedValue ec = nodes.readECFixed();
+        fixedValue do_data = nodes.readDOFixed();
+        fixedValue temperature = nodes.readTemperatureFixed();
+        sensorReading reading = {ph, ec, do_data, temperature};
+
+        // a low DO alarm goes out before the routine data
+        checkAlarm(NODE_ID, reading);
+        aws.processUplink();
+
         // btw this function is specifically made for SFDF project that will format the data into JSON and send it as a String 
         // if you want your own custom String message format it before and use sendDataAWS function in library instead 
-        aws.sendSensorData("sfdf/client01/sensor_data", ph,do_data,ec,temperature);
+        aws.sendSensorData("sfdf/client01/sensor_data", ph,ec,do_data,temperature);
+
+        // publish this node's readings together with everything the sensor slaves sent since last time, tagged by node id
+        // alarms and acks queued meanwhile are sent between the batch messages
+        telemetry.add(NODE_ID, reading);
+        aws.sendTelemetryBatch("sfdf/client01/site_data", telemetry);
 
         // also periodically check the connection of the ESP32 slave, if not connected will attempt to repair
         connectionStatus1 = espNode.addPeer("Slave 1");
     }
 
-    /**
-      Example of receiving message from AWS and based on message relay command to another ESP32 via ESP-Now.
+    // the dispatch task couldn't keep up with the slaves, readings were lost
+    uint32_t dropped_frames = espNode.droppedFrames();
+    if (dropped_frames != reported_dropped_frames)
+    {
+        reported_dropped_frames = dropped_frames;
+        Serial.print("ESP-Now frames dropped: "); Serial.println(dropped_frames);
+    }
+
+    // report how long the last command from AWS took to reach the slave
+    if (command_latency_micros != 0)
+    {
+        unsigned long latency = command_latency_micros;
+        command_latency_micros = 0;
+        max_command_latency_micros = max(max_command_latency_micros, latency);
+        Serial.print("Command latency: "); Serial.print(latency); Serial.print(" us, max "); Serial.print(max_command_latency_micros); Serial.println(" us");
+    }
 
-      In this example, the ESP32 will be checking for AWS messages and if Serial2 contains the word "response", it means that there was a message from AWS with a command
-      such as "PUMPON". Example of the published AWS message for this is {response: "PUMPON"}. Once it receives AWS message with either "PUMPON" or "PUMPOFF", it will activate
-      function sendESPNow.
+    // dump the trace when this iteration went over budget, paste the JSON between TRACE_BEGIN and TRACE_END into ui.perfetto.dev
+    // to see which call took the time. To publish it instead use aws.sendDataAWS("sfdf/client01/trace", Trace.beginDump(), sfdfTrace::writeDump, &Trace)
+    // followed by Trace.endDump()
+    uint32_t loop_time = Trace.loopEnd();
+    if (loop_time > 0)
+    {
+        Serial.print("Loop over budget: "); Serial.print(loop_time); Serial.println(" ms");
+        if (!trace_dumped || millis() - previous_dump_millis >= dump_interval)
+        {
+            Trace.dump(&Serial);
+            previous_dump_millis = millis();
+            trace_dumped = true;
+        }
+    }
+}
 
-      This function in the library is not well written with very limited application, feel free to modify it to your needs or add another function in the library.
-     */
-    else
+// Called by Serial2 in its event task whenever bytes from the SIM7600 arrive
+void onModemReceive()
+{
+    aws.processDownlink();
+}
+
+// Called by the library for every message received from AWS
+void onAWSMessage(const char* topic, const char* payload)
+{
+    // AWS payload message will contain response and either PUMPON or PUMPOFF
+    if (strstr(payload, "response") == NULL)
+    {
+        return;
+    }
+    const char* command = NULL;
+    if (strstr(payload, "PUMPON") != NULL)
+    {
+        command = "PUMPON";
+    }
+    else if (strstr(payload, "PUMPOFF") != NULL)
     {
-      // first parameter is message to look for to indicate message from AWS, second and third are commands, fourth is who to send ESPNow to ("All" or SSID name like "Slave 01"), fourth is what function to activate
-      aws.checkResponseAWS("response","PUMPON", "PUMPOFF", "All", sendESPNow);
+        command = "PUMPOFF";
     }
 
+    if (command != NULL)
+    {
+        command_rx_micros = aws.downlinkReceivedAt();
+        // who to send ESPNow to, "All" or SSID name like "Slave 1" (mac address found by addPeer is reused, no WiFi scan)
+        sendESPNow(command, "All");
+    }
 }
 
 // Example of executing a function once it receives message from AWS
-void sendESPNow(String command ,String slaveName)
+void sendESPNow(const char* command ,const char* slaveName)
 {
     // If passed slaveName is not "All", then send to only one peer with corresponding slaveName
-    if(slaveName != "All")
+    if(strcmp(slaveName, "All") != 0)
     {
         espNode.sendDataSingle(command, slaveName);
     }
@@ -143,6 +265,37 @@ void sendESPNow(String command ,String slaveName)
 
         espNode.sendDataAll(command);
     }
+
+    // tell AWS the command was passed on, acks go ahead of routine telemetry
+    char ack[SIM7600_UPLINK_MSG_LEN];
+    snprintf(ack, sizeof(ack), "{\"ack\":\"%s\",\"to\":\"%s\"}", command, slaveName);
+    aws.queueDataAWS("sfdf/client01/ack", ack, UPLINK_COMMAND_ACK);
+}
+
+// Queues an alarm if a node's dissolved oxygen is too low
+void checkAlarm(uint8_t nodeId, const sensorReading& reading)
+{
+    if (reading.do_data.valid && reading.do_data.raw < do_alarm_level)
+    {
+        char value[FIXED_VALUE_STR_LEN];
+        formatFixed(value, sizeof(value), reading.do_data);
+        char alarm[SIM7600_UPLINK_MSG_LEN];
+        snprintf(alarm, sizeof(alarm), "{\"node\":%u,\"alarm\":\"low_DO\",\"DO\":%s}", nodeId, value);
+        aws.queueDataAWS("sfdf/client01/alarm", alarm, UPLINK_ALARM);
+    }
+}
+
+
+// ESP-Now handler for readings sent by a sensor slave, "TLM <node> <ph> <ec> <do> <temp>", runs in the dispatch task
+void onTelemetry(const uint8_t *mac_addr, const char *args)
+{
+    uint8_t nodeId;
+    sensorReading reading;
+    if (decodeTelemetry(args, nodeId, reading))
+    {
+        checkAlarm(nodeId, reading);
+        telemetry.add(nodeId, reading);
+    }
 }
 
 
@@ -156,4 +309,12 @@ void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
     Serial.print("Last Packet Sent to: "); Serial.println(macStr);
     // check status
     Serial.print("Last Packet Send Status: "); Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
+
+    // a slave's WiFi acknowledged the frame of a command from AWS, its handler runs after this. Time beacons go to the broadcast
+    // address and don't count
+    if (command_rx_micros != 0 && mac_addr[0] != 0xFF && status == ESP_NOW_SEND_SUCCESS)
+    {
+        command_latency_micros = micros() - command_rx_micros;
+        command_rx_micros = 0;
+    }
 }
\ No newline at end of file